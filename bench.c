@@ -0,0 +1,296 @@
+/*
+ * bench.c - Measure how fast csim simulates
+ *
+ * Replays traces/long.trace and two generated binary traces (a streaming
+ * kernel and uniformly random accesses) through ./csim over a matrix of
+ * cache geometries, then replays the streaming trace again at every
+ * thread count up to -j. Each run is a separate csim process, so the
+ * times include reading the trace and the peak RSS is csim's own. csim -e
+ * reports the share of accesses block-run folding counted without a lookup.
+ * Results are printed and written as CSV.
+ *
+ *   linux> make bench
+ *   linux> ./csim-bench -n 10000000 -j 4 -o quick.csv
+ */
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define DEFAULT_RECORDS 200000000ULL // records in each generated trace
+#define DEFAULT_THREADS 8 // the most threads the scaling runs use
+#define STREAM_ARRAYS 3 // arrays the streaming trace walks through at once
+#define RANDOM_BYTES (1ULL << 28) // the span the random trace's accesses fall in
+
+typedef struct geometry {
+	int s;
+	int E;
+	int b;
+} geometry;
+
+/* The cache shapes every trace is replayed through */
+static const geometry matrix[] = {
+	{ 5, 1, 5 }, // the cache test-trans grades with
+	{ 6, 8, 6 }, // a typical L1
+	{ 10, 16, 6 }, // a typical L2
+	{ 14, 4, 6 }, // lots of sets, for the set-parallel runs
+};
+
+/* The geometry the thread scaling runs use */
+static const geometry scaling = { 10, 16, 6 };
+
+typedef struct benchTrace {
+	const char* name; // what the CSV calls it
+	char file[256];
+	int binary; // replayed with -T instead of -t
+	unsigned long long records; // accesses in the trace
+} benchTrace;
+
+void usage(char* argv[]) {
+	printf("Usage: %s [-h] [-n <records>] [-j <threads>] [-o <csv>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h            Print this help message.\n");
+	printf("  -n <records>  Records in each generated trace (default %llu).\n", DEFAULT_RECORDS);
+	printf("  -j <threads>  Scale the threaded runs up to this many threads (default %d).\n", DEFAULT_THREADS);
+	printf("  -o <csv>      Where to write the results (default bench.csv).\n");
+}
+
+static unsigned long long nextRandom(unsigned long long* state) {
+	unsigned long long x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+/*
+ * Write a generated trace unless one of the same size is already there.
+ * "stream" loads from two arrays and stores to a third, 4 bytes at a time;
+ * "random" loads and stores 8 bytes anywhere in RANDOM_BYTES.
+ */
+int generateTrace(benchTrace* trace) {
+	struct stat st;
+	if(stat(trace->file, &st) == 0) {
+		return 0;
+	}
+
+	printf("Generating %s (%llu records)\n", trace->file, trace->records);
+	fflush(stdout);
+	FILE* out = fopen(trace->file, "wb");
+	if(out == NULL) {
+		perror(trace->file);
+		return 1;
+	}
+	binTraceWriter* writer = newTraceWriter(out, TRACE_BLOCK_RECORDS);
+	unsigned long long state = 0x9e3779b97f4a7c15ULL;
+	traceRecord rec;
+	for(unsigned long long i = 0; i < trace->records; i++) {
+		if(strcmp(trace->name, "stream") == 0) {
+			unsigned long long array = i % STREAM_ARRAYS;
+			rec.address = 0x10000000ULL * (array + 1) + 4 * (i / STREAM_ARRAYS);
+			rec.len = 4;
+			rec.op = array == STREAM_ARRAYS - 1 ? 'S' : 'L';
+		}
+		else {
+			unsigned long long r = nextRandom(&state);
+			rec.address = 0x10000000ULL + ((r >> 8) & (RANDOM_BYTES - 1) & ~7ULL);
+			rec.len = 8;
+			rec.op = (r & 3) == 0 ? 'S' : 'L';
+		}
+		writeTraceRecord(writer, &rec);
+	}
+	int status = closeTraceWriter(writer);
+	fclose(out);
+	if(status != 0) {
+		unlink(trace->file);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * The number of accesses in a text trace
+ */
+unsigned long long countRecords(const char* file) {
+	int fd = open(file, O_RDONLY);
+	struct stat st;
+	unsigned long long count = 0;
+
+	if(fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		if(fd >= 0) {
+			close(fd);
+		}
+		return 0;
+	}
+	const char* map = (const char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		return 0;
+	}
+	const char* pos = map;
+	const char* end = map + st.st_size;
+	traceRecord rec;
+	initTraceParser();
+	while(pos < end) {
+		count += parseTraceLine(&pos, end, &rec);
+	}
+	munmap((void*) map, st.st_size);
+	return count;
+}
+
+/*
+ * Run csim once, reading only its -e line. Returns 0 and fills in the wall
+ * time, the peak RSS and the share of accesses folded if it succeeded.
+ */
+int runCsim(const benchTrace* trace, geometry g, int threads, double* seconds, long* rssKb, double* folded) {
+	char s[16], E[16], b[16], j[16];
+	snprintf(s, sizeof(s), "%d", g.s);
+	snprintf(E, sizeof(E), "%d", g.E);
+	snprintf(b, sizeof(b), "%d", g.b);
+	snprintf(j, sizeof(j), "%d", threads);
+	char* args[] = { "./csim", "-e", "-s", s, "-E", E, "-b", b, "-j", j,
+			trace->binary ? "-T" : "-t", (char*) trace->file, NULL };
+
+	int out[2];
+	if(pipe(out) != 0) {
+		perror("pipe");
+		return 1;
+	}
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid_t pid = fork();
+	if(pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if(pid == 0) {
+		close(out[0]);
+		dup2(out[1], STDOUT_FILENO);
+		execv(args[0], args);
+		_exit(127);
+	}
+	close(out[1]);
+	FILE* fp = fdopen(out[0], "r");
+	char line[256];
+	unsigned long long foldedAccesses = 0, accesses = 0;
+	while(fgets(line, sizeof(line), fp) != NULL) { // csim only writes a few lines, so it never blocks on the pipe
+		sscanf(line, "folded:%llu accesses:%llu", &foldedAccesses, &accesses);
+	}
+	fclose(fp);
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) < 0) {
+		perror("wait4");
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "csim failed on %s\n", trace->file);
+		return 1;
+	}
+	*seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	*rssKb = usage.ru_maxrss;
+	*folded = accesses > 0 ? (double) foldedAccesses / accesses : 0;
+	return 0;
+}
+
+/*
+ * Run one configuration and report it on stdout and in the CSV
+ */
+int bench(FILE* csv, const benchTrace* trace, geometry g, int threads) {
+	double seconds, folded;
+	long rssKb;
+
+	if(runCsim(trace, g, threads, &seconds, &rssKb, &folded) != 0) {
+		return 1;
+	}
+	double rate = trace->records / seconds;
+	double ns = seconds * 1e9 / trace->records;
+	printf("%-8s s=%-2d E=%-2d b=%-2d j=%-3d %8.3fs %12.0f accesses/s %8.2f ns/access %8ld KB %5.1f%% folded\n",
+			trace->name, g.s, g.E, g.b, threads, seconds, rate, ns, rssKb, 100 * folded);
+	fprintf(csv, "%s,%llu,%d,%d,%d,%d,%.6f,%.0f,%.3f,%ld,%.4f\n",
+			trace->name, trace->records, g.s, g.E, g.b, threads, seconds, rate, ns, rssKb, folded);
+	fflush(stdout);
+	fflush(csv);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	unsigned long long records = DEFAULT_RECORDS;
+	int maxThreads = DEFAULT_THREADS;
+	char* outfile = "bench.csv";
+	int opt, status = 0;
+
+	while((opt = getopt(argc, argv, "hn:j:o:")) != -1) {
+		switch(opt) {
+		case 'h':
+			usage(argv);
+			exit(0);
+		case 'n':
+			records = strtoull(optarg, NULL, 10);
+			break;
+		case 'j':
+			maxThreads = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+	if(records == 0 || maxThreads < 1) {
+		usage(argv);
+		exit(1);
+	}
+
+	benchTrace traces[3] = {
+		{ "long", "traces/long.trace", 0, 0 },
+		{ "stream", "", 1, records },
+		{ "random", "", 1, records },
+	};
+	traces[0].records = countRecords(traces[0].file);
+	if(traces[0].records == 0) {
+		fprintf(stderr, "Can't read %s\n", traces[0].file);
+		exit(1);
+	}
+	for(int i = 1; i < 3; i++) {
+		snprintf(traces[i].file, sizeof(traces[i].file), "bench-%s-%llu.btrace", traces[i].name, records);
+		if(generateTrace(&traces[i]) != 0) {
+			exit(1);
+		}
+	}
+
+	FILE* csv = fopen(outfile, "w");
+	if(csv == NULL) {
+		perror(outfile);
+		exit(1);
+	}
+	fprintf(csv, "trace,records,s,E,b,threads,seconds,accesses_per_sec,ns_per_access,peak_rss_kb,folded_fraction\n");
+
+	for(int i = 0; i < 3; i++) {
+		for(size_t g = 0; g < sizeof(matrix) / sizeof(matrix[0]); g++) {
+			status |= bench(csv, &traces[i], matrix[g], 1);
+		}
+	}
+	for(int threads = 2; threads <= maxThreads; threads *= 2) {
+		status |= bench(csv, &traces[1], scaling, threads);
+	}
+
+	fclose(csv);
+	printf("Results are in %s\n", outfile);
+	return status;
+}
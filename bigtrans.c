@@ -0,0 +1,214 @@
+/*
+ * bigtrans.c - Matrices of any size, and a multithreaded tiled transpose
+ *     (see bigtrans.h)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "bigtrans.h"
+
+#define BAND_ALIGN 16 /* band edges fall on 64-byte lines of A */
+
+typedef struct band_job {
+    int M;
+    int N;
+    const int* A;
+    int* A_out; /* fillMatrices writes A, the transpose only reads it */
+    int* B;
+    int tile;
+    int first; /* B rows [first, last) */
+    int last;
+    int cpu; /* where to pin the thread, or -1 */
+} band_job_t;
+
+/*
+ * mapping_size - Bytes in the mapping behind a rows x cols matrix
+ */
+static size_t mapping_size(size_t rows, size_t cols)
+{
+    size_t bytes = rows * cols * sizeof(int);
+    return bytes > 0 ? bytes : 1;
+}
+
+/*
+ * newMatrix - Map a zeroed matrix. The pages aren't allocated until
+ *     they're first touched, which is how fillMatrices places B's rows
+ *     (see bigtrans.h).
+ */
+int* newMatrix(size_t rows, size_t cols, int huge)
+{
+    size_t bytes = mapping_size(rows, cols);
+    void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (map == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (huge && madvise(map, bytes, MADV_HUGEPAGE) != 0)
+        perror("madvise(MADV_HUGEPAGE)");
+#else
+    (void) huge;
+#endif
+    return (int*) map;
+}
+
+void freeMatrix(int* matrix, size_t rows, size_t cols)
+{
+    if (matrix)
+        munmap(matrix, mapping_size(rows, cols));
+}
+
+/*
+ * band_edge - Where thread t's band of rows starts, out of rows split
+ *     among threads
+ */
+static int band_edge(int t, int threads, int rows)
+{
+    long long edge = (long long) rows * t / threads;
+
+    if (t == threads)
+        return rows;
+    return (int) (edge - edge % BAND_ALIGN);
+}
+
+/*
+ * pick_cpu - The CPU thread t runs on: the t-th one this process may use,
+ *     wrapping around, or -1 if that can't be found out
+ */
+static int pick_cpu(int t)
+{
+    cpu_set_t allowed;
+    int count, cpu, seen = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return -1;
+    count = CPU_COUNT(&allowed);
+    if (count == 0)
+        return -1;
+    t %= count;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && seen++ == t)
+            return cpu;
+    }
+    return -1;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t mask;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+/*
+ * fill_band - Write A's columns and B's rows in [first, last). Each
+ *     thread writes its band of every row of A, touching N pages in turn
+ *     that the other threads share, so only B's pages end up on its node.
+ */
+static void* fill_band(void* arg)
+{
+    band_job_t* job = (band_job_t*) arg;
+    size_t M = job->M, N = job->N, i, j;
+
+    pin(job->cpu);
+    for (i = 0; i < N; i++)
+        for (j = job->first; j < job->last; j++)
+            job->A_out[i * M + j] = (int) (i * 2654435761u + j * 40503u);
+    for (j = job->first; j < job->last; j++)
+        memset(&job->B[j * N], 0, N * sizeof(int));
+    return NULL;
+}
+
+/*
+ * transpose_band - Transpose A's columns [first, last) into B's rows,
+ *     a tile at a time, finishing each band of B's rows before the next
+ */
+static void* transpose_band(void* arg)
+{
+    band_job_t* job = (band_job_t*) arg;
+    size_t M = job->M, N = job->N, tile = job->tile;
+    size_t i, j, ii, jj, i_end, j_end;
+    const int* A = job->A;
+    int* B = job->B;
+
+    pin(job->cpu);
+    for (jj = job->first; jj < (size_t) job->last; jj += tile) {
+        j_end = jj + tile < (size_t) job->last ? jj + tile : (size_t) job->last;
+        for (ii = 0; ii < N; ii += tile) {
+            i_end = ii + tile < N ? ii + tile : N;
+            for (j = jj; j < j_end; j++)
+                for (i = ii; i < i_end; i++)
+                    B[j * N + i] = A[i * M + j];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * run_bands - Run work on each thread's band, in the calling thread if
+ *     there's only one
+ */
+static void run_bands(band_job_t* proto, int threads, void* (*work)(void*))
+{
+    pthread_t tids[MAX_TRANS_THREADS];
+    band_job_t jobs[MAX_TRANS_THREADS];
+    int t, started;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > MAX_TRANS_THREADS)
+        threads = MAX_TRANS_THREADS;
+    for (t = 0; t < threads; t++) {
+        jobs[t] = *proto;
+        jobs[t].first = band_edge(t, threads, proto->M);
+        jobs[t].last = band_edge(t + 1, threads, proto->M);
+        jobs[t].cpu = threads > 1 ? pick_cpu(t) : -1;
+    }
+    if (threads == 1) {
+        work(&jobs[0]);
+        return;
+    }
+
+    for (started = 0; started < threads; started++) {
+        if (pthread_create(&tids[started], NULL, work, &jobs[started]) != 0)
+            break;
+    }
+    for (t = started; t < threads; t++) { /* do whatever couldn't get a thread here */
+        jobs[t].cpu = -1; /* without pinning the caller for good */
+        work(&jobs[t]);
+    }
+    for (t = 0; t < started; t++)
+        pthread_join(tids[t], NULL);
+}
+
+void fillMatrices(int M, int N, int* A, int* B, int threads)
+{
+    band_job_t proto = { M, N, A, A, B, 0, 0, 0, -1 };
+
+    run_bands(&proto, threads, fill_band);
+}
+
+void parallelTranspose(int M, int N, const int* A, int* B, int tile, int threads)
+{
+    band_job_t proto = { M, N, A, NULL, B, tile > 0 ? tile : 1, 0, 0, -1 };
+
+    run_bands(&proto, threads, transpose_band);
+}
+
+int checkTranspose(int M, int N, const int* A, const int* B)
+{
+    size_t i, j;
+
+    for (i = 0; i < (size_t) N; i++)
+        for (j = 0; j < (size_t) M; j++)
+            if (B[j * N + i] != A[i * M + j])
+                return 0;
+    return 1;
+}
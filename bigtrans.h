@@ -0,0 +1,45 @@
+/*
+ * bigtrans.h - Matrices of any size, and a multithreaded tiled transpose
+ *
+ * The traced matrices in transtrace.h are fixed at TRACE_MAXN, because
+ * every access to them is simulated. Timing doesn't have that limit, so
+ * test-trans -t and trans-bench put their matrices in mappings of their
+ * own, optionally backed by transparent huge pages.
+ *
+ * The parallel transpose gives each thread a band of B's rows (A's
+ * columns) and walks it in tile x tile tiles. fillMatrices splits the
+ * matrices the same way and pins each thread to the same CPU, so under
+ * Linux's first-touch policy the pages of B a thread writes are allocated
+ * on its own NUMA node. A gets no such placement: a band of A's columns
+ * cuts across every row, so each of its pages holds several threads'
+ * columns and lands wherever the first of them touched it. Even for B
+ * that only holds with 4KB pages: a huge page is placed by whichever
+ * thread touches it first.
+ */
+#ifndef CACHELAB_BIGTRANS_H
+#define CACHELAB_BIGTRANS_H
+
+#include <stddef.h>
+
+#define MAX_TRANS_THREADS 256
+
+/* A rows x cols matrix in its own mapping, or NULL. huge asks for transparent huge pages. */
+int* newMatrix(size_t rows, size_t cols, int huge);
+
+/* Unmap a matrix from newMatrix */
+void freeMatrix(int* matrix, size_t rows, size_t cols);
+
+/*
+ * fillMatrices - Fill the N x M matrix A with data and zero the M x N
+ *     matrix B, with the threads parallelTranspose would use touching
+ *     the parts it would give them
+ */
+void fillMatrices(int M, int N, int* A, int* B, int threads);
+
+/* Transpose A into B, splitting B's rows among threads in tile x tile tiles */
+void parallelTranspose(int M, int N, const int* A, int* B, int tile, int threads);
+
+/* 1 if B is the transpose of A */
+int checkTranspose(int M, int N, const int* A, const int* B);
+
+#endif /* CACHELAB_BIGTRANS_H */
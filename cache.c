@@ -0,0 +1,888 @@
+/*
+ * cache.c - Cache storage, replacement policies and the per-access hot loop
+ *
+ * Every policy supplies Init, Hit, Victim and Fill routines working on one
+ * set. DEFINE_ACCESS pastes them into a copy of the access loop for each
+ * policy and for E = 1, 2, 4 and any other E, so the compiler can inline the
+ * policy and unroll the small tag searches. Victim selection is O(1) or
+ * O(log E) (O(E/64) for the bitmask policies past 64 lines).
+ */
+#define _DEFAULT_SOURCE
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define NONE 0xffffffffu // an empty link in the LRU list
+#define BITWORDS(E) (((E) + 63) / 64) // 64-bit words in a bitmask of E lines
+#define BRRIP_NEAR 32 // BRRIP predicts one fill in this many as near
+
+#define META(cache, set, w, way) (cache)->meta[((size_t) (set) * (cache)->lineWords + (w)) * (cache)->ways + (way)]
+#define SETMETA(cache, set, w) (cache)->setMeta[(size_t) (set) * (cache)->setWords + (w)]
+
+static const char* policyNames[NUM_POLICIES] = { "lru", "fifo", "random", "plru", "nru", "srrip", "brrip", "lfu" };
+
+int parsePolicy(const char* name) {
+	for(int i = 0; i < NUM_POLICIES; i++) {
+		if(strcmp(name, policyNames[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char* policyName(replacementPolicy policy) {
+	return policyNames[policy];
+}
+
+/*
+ * Small per-set random number generators, so results don't depend on how sets are split across threads
+ */
+static unsigned long long splitMix(unsigned long long x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static inline unsigned int nextRandom(unsigned long long* state) {
+	unsigned long long x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+/*
+ * Bitmask helpers shared by tree-PLRU, NRU and RRIP
+ */
+static inline int testBit(const unsigned long long* words, int i) {
+	return (words[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void setBit(unsigned long long* words, int i) {
+	words[i >> 6] |= 1ULL << (i & 63);
+}
+
+static inline void clearBit(unsigned long long* words, int i) {
+	words[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+/*
+ * LRU: a doubly linked recency list per set (word 0 links toward the most
+ * recently used line, word 1 toward the least). The set's word holds the head
+ * in its low half and the tail in its high half.
+ */
+static inline void lruUnlink(Cache* cache, size_t set, int way) {
+	unsigned long long ends = SETMETA(cache, set, 0);
+	unsigned int prev = META(cache, set, 0, way);
+	unsigned int next = META(cache, set, 1, way);
+	unsigned int head = ends, tail = ends >> 32;
+
+	if(prev == NONE) { head = next; } else { META(cache, set, 1, prev) = next; }
+	if(next == NONE) { tail = prev; } else { META(cache, set, 0, next) = prev; }
+	SETMETA(cache, set, 0) = head | ((unsigned long long) tail << 32);
+}
+
+static inline void lruPushFront(Cache* cache, size_t set, int way) {
+	unsigned long long ends = SETMETA(cache, set, 0);
+	unsigned int head = ends, tail = ends >> 32;
+
+	META(cache, set, 0, way) = NONE;
+	META(cache, set, 1, way) = head;
+	if(head == NONE) { tail = way; } else { META(cache, set, 0, head) = way; }
+	SETMETA(cache, set, 0) = (unsigned int) way | ((unsigned long long) tail << 32);
+}
+
+static inline void lruInit(Cache* cache, size_t set, int E) {
+	SETMETA(cache, set, 0) = NONE | ((unsigned long long) NONE << 32);
+}
+
+static inline void lruHit(Cache* cache, size_t set, int way, int E) {
+	if((unsigned int) SETMETA(cache, set, 0) != (unsigned int) way) { // already the most recent otherwise
+		lruUnlink(cache, set, way);
+		lruPushFront(cache, set, way);
+	}
+}
+
+static inline int lruVictim(Cache* cache, size_t set, int E) {
+	return SETMETA(cache, set, 0) >> 32;
+}
+
+static inline void lruFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	if(replaced) {
+		lruHit(cache, set, way, E);
+	}
+	else {
+		lruPushFront(cache, set, way);
+	}
+}
+
+static inline void lruRemove(Cache* cache, size_t set, int way, int E) {
+	lruUnlink(cache, set, way);
+}
+
+/*
+ * FIFO: lines fill in order, so once a set is full the victims just go round.
+ * A line refilled after an invalidation keeps its old place in the rotation.
+ */
+static inline void fifoInit(Cache* cache, size_t set, int E) {
+	SETMETA(cache, set, 0) = 0;
+}
+
+static inline void fifoHit(Cache* cache, size_t set, int way, int E) {
+}
+
+static inline int fifoVictim(Cache* cache, size_t set, int E) {
+	int victim = SETMETA(cache, set, 0);
+	SETMETA(cache, set, 0) = victim + 1 == E ? 0 : victim + 1;
+	return victim;
+}
+
+static inline void fifoFill(Cache* cache, size_t set, int way, int E, int replaced) {
+}
+
+static inline void fifoRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+/*
+ * Random: each set has its own generator seeded from the set number
+ */
+static inline void randomInit(Cache* cache, size_t set, int E) {
+	SETMETA(cache, set, 0) = splitMix(set + 1);
+}
+
+static inline void randomHit(Cache* cache, size_t set, int way, int E) {
+}
+
+static inline int randomVictim(Cache* cache, size_t set, int E) {
+	return nextRandom(&SETMETA(cache, set, 0)) % E;
+}
+
+static inline void randomFill(Cache* cache, size_t set, int way, int E, int replaced) {
+}
+
+static inline void randomRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+/*
+ * Tree-PLRU: node n (1 to E-1) has children 2n and 2n+1, and line i is leaf E+i.
+ * A set bit means the victim is down the right side.
+ */
+static inline void plruInit(Cache* cache, size_t set, int E) {
+	memset(&SETMETA(cache, set, 0), 0, cache->setWords * sizeof(unsigned long long));
+}
+
+static inline void plruHit(Cache* cache, size_t set, int way, int E) {
+	unsigned long long* bits = &SETMETA(cache, set, 0);
+	int node = 1;
+	for(int bit = E >> 1; bit; bit >>= 1) { // point every node on the way down away from this line
+		int right = (way & bit) != 0;
+		if(right) { clearBit(bits, node); } else { setBit(bits, node); }
+		node = 2 * node + right;
+	}
+}
+
+static inline int plruVictim(Cache* cache, size_t set, int E) {
+	const unsigned long long* bits = &SETMETA(cache, set, 0);
+	int node = 1;
+	while(node < E) {
+		node = 2 * node + testBit(bits, node);
+	}
+	return node - E;
+}
+
+static inline void plruFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	plruHit(cache, set, way, E);
+}
+
+static inline void plruRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+/*
+ * NRU: one referenced bit per line. When the last one is set, every other bit is cleared.
+ */
+static inline void nruInit(Cache* cache, size_t set, int E) {
+	memset(&SETMETA(cache, set, 0), 0, cache->setWords * sizeof(unsigned long long));
+}
+
+static inline void nruHit(Cache* cache, size_t set, int way, int E) {
+	unsigned long long* bits = &SETMETA(cache, set, 0);
+	int words = BITWORDS(E);
+
+	setBit(bits, way);
+	for(int k = 0; k < words; k++) {
+		unsigned long long all = (k == words - 1 && (E & 63)) ? (1ULL << (E & 63)) - 1 : ~0ULL;
+		if(bits[k] != all) {
+			return;
+		}
+	}
+	memset(bits, 0, words * sizeof(unsigned long long)); // everything was used, so start a new epoch
+	setBit(bits, way);
+}
+
+static inline int nruVictim(Cache* cache, size_t set, int E) {
+	const unsigned long long* bits = &SETMETA(cache, set, 0);
+	for(int k = 0; k < BITWORDS(E); k++) {
+		if(~bits[k]) {
+			int way = 64 * k + __builtin_ctzll(~bits[k]);
+			return way < E ? way : 0;
+		}
+	}
+	return 0; // only possible when E is 1
+}
+
+static inline void nruFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	nruHit(cache, set, way, E);
+}
+
+static inline void nruRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+/*
+ * RRIP: a 2-bit re-reference prediction value per line, kept as four bitmasks
+ * (one per value) so finding a distant line and aging the set are word operations.
+ */
+static inline void rripInit(Cache* cache, size_t set, int E) {
+	memset(&SETMETA(cache, set, 0), 0, 4 * BITWORDS(E) * sizeof(unsigned long long));
+}
+
+static inline void rripSet(Cache* cache, size_t set, int way, int E, int value) {
+	unsigned long long* masks = &SETMETA(cache, set, 0);
+	int words = BITWORDS(E);
+	for(int v = 0; v < 4; v++) {
+		clearBit(masks + v * words, way);
+	}
+	setBit(masks + value * words, way);
+}
+
+static inline int rripVictim(Cache* cache, size_t set, int E) {
+	unsigned long long* masks = &SETMETA(cache, set, 0);
+	int words = BITWORDS(E);
+
+	for(;;) { // a full set reaches a distant line after at most three rounds of aging
+		for(int k = 0; k < words; k++) {
+			if(masks[3 * words + k]) {
+				return 64 * k + __builtin_ctzll(masks[3 * words + k]);
+			}
+		}
+		for(int k = 0; k < words; k++) {
+			masks[3 * words + k] |= masks[2 * words + k];
+			masks[2 * words + k] = masks[words + k];
+			masks[words + k] = masks[k];
+			masks[k] = 0;
+		}
+	}
+}
+
+static inline void srripInit(Cache* cache, size_t set, int E) {
+	rripInit(cache, set, E);
+}
+
+static inline void srripHit(Cache* cache, size_t set, int way, int E) {
+	rripSet(cache, set, way, E, 0);
+}
+
+static inline int srripVictim(Cache* cache, size_t set, int E) {
+	return rripVictim(cache, set, E);
+}
+
+static inline void srripFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	rripSet(cache, set, way, E, 2); // a long re-reference interval
+}
+
+static inline void srripRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+static inline void brripInit(Cache* cache, size_t set, int E) {
+	rripInit(cache, set, E);
+	SETMETA(cache, set, 4 * BITWORDS(E)) = splitMix(set + 1);
+}
+
+static inline void brripHit(Cache* cache, size_t set, int way, int E) {
+	rripSet(cache, set, way, E, 0);
+}
+
+static inline int brripVictim(Cache* cache, size_t set, int E) {
+	return rripVictim(cache, set, E);
+}
+
+static inline void brripFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	int nearFill = nextRandom(&SETMETA(cache, set, 4 * BITWORDS(E))) % BRRIP_NEAR == 0;
+	rripSet(cache, set, way, E, nearFill ? 2 : 3);
+}
+
+static inline void brripRemove(Cache* cache, size_t set, int way, int E) {
+}
+
+/*
+ * LFU: a binary min-heap of the set's lines ordered by use count, then by when
+ * they were last used. Words per line: 0 count, 1 last use, 2 the line in each
+ * heap slot, 3 the heap slot of each line. The set's word is its clock.
+ */
+static inline int lfuLess(Cache* cache, size_t set, unsigned int a, unsigned int b) {
+	unsigned int countA = META(cache, set, 0, a), countB = META(cache, set, 0, b);
+	return countA < countB || (countA == countB && META(cache, set, 1, a) < META(cache, set, 1, b));
+}
+
+static inline void lfuPlace(Cache* cache, size_t set, int slot, unsigned int way) {
+	META(cache, set, 2, slot) = way;
+	META(cache, set, 3, way) = slot;
+}
+
+static inline void lfuSiftUp(Cache* cache, size_t set, int slot) {
+	unsigned int way = META(cache, set, 2, slot);
+	while(slot > 0) {
+		int parent = (slot - 1) / 2;
+		unsigned int above = META(cache, set, 2, parent);
+		if(!lfuLess(cache, set, way, above)) {
+			break;
+		}
+		lfuPlace(cache, set, slot, above);
+		slot = parent;
+	}
+	lfuPlace(cache, set, slot, way);
+}
+
+static inline void lfuSiftDown(Cache* cache, size_t set, int slot, int size) {
+	unsigned int way = META(cache, set, 2, slot);
+	for(;;) {
+		int child = 2 * slot + 1;
+		if(child >= size) {
+			break;
+		}
+		if(child + 1 < size && lfuLess(cache, set, META(cache, set, 2, child + 1), META(cache, set, 2, child))) {
+			child++;
+		}
+		unsigned int below = META(cache, set, 2, child);
+		if(!lfuLess(cache, set, below, way)) {
+			break;
+		}
+		lfuPlace(cache, set, slot, below);
+		slot = child;
+	}
+	lfuPlace(cache, set, slot, way);
+}
+
+static inline void lfuInit(Cache* cache, size_t set, int E) {
+	SETMETA(cache, set, 0) = 0;
+}
+
+static inline void lfuHit(Cache* cache, size_t set, int way, int E) {
+	if(META(cache, set, 0, way) != UINT_MAX) {
+		META(cache, set, 0, way)++;
+	}
+	META(cache, set, 1, way) = SETMETA(cache, set, 0)++;
+	lfuSiftDown(cache, set, META(cache, set, 3, way), cache->filled[set]); // its key only grew
+}
+
+static inline int lfuVictim(Cache* cache, size_t set, int E) {
+	return META(cache, set, 2, 0);
+}
+
+static inline void lfuFill(Cache* cache, size_t set, int way, int E, int replaced) {
+	META(cache, set, 0, way) = 1;
+	META(cache, set, 1, way) = SETMETA(cache, set, 0)++;
+	if(replaced) { // the victim was the root
+		lfuSiftDown(cache, set, META(cache, set, 3, way), cache->filled[set]);
+	}
+	else { // a new line goes at the end of the heap
+		lfuPlace(cache, set, cache->filled[set], way);
+		lfuSiftUp(cache, set, cache->filled[set]);
+	}
+}
+
+static inline void lfuRemove(Cache* cache, size_t set, int way, int E) {
+	int slot = META(cache, set, 3, way);
+	int last = cache->filled[set] - 1;
+	if(slot < last) { // move the last heap entry into the hole and let it settle
+		lfuPlace(cache, set, slot, META(cache, set, 2, last));
+		lfuSiftDown(cache, set, slot, last);
+		lfuSiftUp(cache, set, slot);
+	}
+}
+
+/*
+ * The tag searches for the specialized small-E loops; the compiler unrolls them
+ */
+static inline int smallFindHitWide(const unsigned long long* tags, const unsigned char* valid, int E, unsigned long long tag) {
+	for(int i = 0; i < E; i++) {
+		if(valid[i] && tags[i] == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static inline int smallFindHitNarrow(const unsigned int* tags, const unsigned char* valid, int E, unsigned int tag) {
+	for(int i = 0; i < E; i++) {
+		if(valid[i] && tags[i] == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * How DEFINE_ACCESS stores tags: in full (Wide), or packed into their low
+ * 32 bits while every line shares cache->tagHigh above them (Narrow). A
+ * narrow access whose tag doesn't pack calls fitTag and starts over.
+ */
+#define Wide_TYPE unsigned long long
+#define Wide_TAGS(cache) (cache)->tags
+#define Wide_FULL(cache, tag) (tag)
+#define Wide_FIND findHit
+#define Wide_CHECK
+#define Wide_PIN
+
+#define Narrow_TYPE unsigned int
+#define Narrow_TAGS(cache) (cache)->narrowTags
+#define Narrow_FULL(cache, tag) (((cache)->tagHigh << 32) | (tag))
+#define Narrow_FIND findHit32
+#define Narrow_CHECK \
+	if((fullTag >> 32) != cache->tagHigh) { \
+		fitTag(cache, *info, address); \
+		return cache->access(cache, info, address, request, size, verbose, evicted); \
+	}
+#define Narrow_PIN cache->tagsPinned = 1;
+
+/*
+ * The line holding address in the set starting at base, or -1
+ */
+static inline int findLine(Cache* cache, cacheInfo info, unsigned long long address, size_t base) {
+	unsigned long long tag = address >> (info.s + info.b);
+	if(cache->wideTags) {
+		return cache->lookup.findHit(cache->tags + base, cache->valid + base, cache->ways, tag);
+	}
+	if((tag >> 32) != cache->tagHigh) {
+		return -1;
+	}
+	return cache->lookup.findHit32(cache->narrowTags + base, cache->valid + base, cache->ways, (unsigned int) tag);
+}
+
+/**
+ * A simple method that checks to see if any line is invalid (AKA empty) and returns that index
+ */
+static int findEmptyIndex(Cache* cache, size_t base, int E) {
+	int i = cache->lookup.findEmpty(cache->valid + base, cache->ways);
+	return i < E ? i : -1; // padding lines always look empty
+}
+
+/*
+ * A store landing on a line: mark it dirty, or write the bytes through
+ */
+static inline int storeLine(Cache* cache, cacheInfo* info, size_t line, unsigned int size, int result) {
+	if(cache->writeBack) {
+		cache->state[line] |= LINE_DIRTY;
+		return result;
+	}
+	info->bytesWritten += size;
+	return result | ACCESS_FORWARD;
+}
+
+/*
+ * Process the cache and adjust the number of hits, misses evictions, for policy P,
+ * a compile-time E (or info->E when CONST_E is 0) and tag storage W
+ */
+#define DEFINE_ACCESS(P, SUFFIX, CONST_E, W) \
+static int P##Access##SUFFIX##W(Cache* cache, cacheInfo* info, unsigned long long address, int request, unsigned int size, int verbose, unsigned long long* evicted) { \
+	const int E = CONST_E ? CONST_E : info->E; \
+	unsigned long long fullTag = address >> (info->s + info->b); /* find the tag (which is shifted over by s and b to be comparable to our tag) */ \
+	W##_CHECK \
+	W##_TYPE tag = (W##_TYPE) fullTag; \
+	W##_TYPE* tags = W##_TAGS(cache); \
+	size_t setNum = (address >> info->b) & (info->S - 1); /* find the appropriate number of the set */ \
+	size_t base = setNum * (CONST_E ? CONST_E : cache->ways); /* where the current set's lines start */ \
+	int hitIndex = CONST_E ? smallFindHit##W(tags + base, cache->valid + base, E, tag) \
+			: cache->lookup.W##_FIND(tags + base, cache->valid + base, cache->ways, tag); \
+	int install = request >= REQUEST_INSTALL; /* blocks from the level above aren't hits or misses */ \
+	int write = request == REQUEST_WRITE || request == REQUEST_WRITEBACK; \
+	int result = ACCESS_MISS; \
+	int way; \
+\
+	if(hitIndex >= 0) { /* if a valid line's tag matches, then hit */ \
+		if(!install) { /* an install isn't a use, so the policy doesn't hear about it */ \
+			info->numHits++; \
+			if(verbose) { printf("hit "); } \
+			P##Hit(cache, setNum, hitIndex, E); \
+		} \
+		return write ? storeLine(cache, info, base + hitIndex, size, ACCESS_HIT) : ACCESS_HIT; \
+	} \
+\
+	if(!install) { \
+		info->numMisses++; /* if we've made it to this point, we know there wasn't a hit and we missed */ \
+		if(verbose) { printf("miss "); } \
+	} \
+	if(write && !cache->writeAllocate) { /* the store goes around the cache */ \
+		info->bytesWritten += size; \
+		return ACCESS_MISS | ACCESS_FORWARD; \
+	} \
+	if(!install || request == REQUEST_PREFETCH) { /* an install brings its own data, a prefetch reads it */ \
+		info->bytesRead += info->B; \
+		result |= ACCESS_FILL; \
+	} \
+	W##_PIN \
+\
+	if(cache->filled[setNum] < (unsigned int) E) { /* if cache is not full, use an empty line */ \
+		way = findEmptyIndex(cache, base, E); \
+		cache->valid[base + way] = 1; \
+		tags[base + way] = tag; \
+		P##Fill(cache, setNum, way, E, 0); \
+		cache->filled[setNum]++; \
+	} \
+	else { \
+		info->numEvicts++; /* if there is no empty space (cache is full), we must evict */ \
+		if(verbose) { printf("eviction "); } \
+		way = P##Victim(cache, setNum, E); \
+		*evicted = (W##_FULL(cache, tags[base + way]) << (info->s + info->b)) | (setNum << info->b); \
+		result |= ACCESS_EVICT; \
+		if(cache->state[base + way] & LINE_DIRTY) { /* the victim's data has to go down first */ \
+			info->numDirtyEvicts++; \
+			info->bytesWritten += info->B; \
+			result |= ACCESS_DIRTY; \
+		} \
+		if(cache->state[base + way] & LINE_PREFETCHED) { \
+			result |= ACCESS_UNUSED; \
+		} \
+		tags[base + way] = tag; \
+		P##Fill(cache, setNum, way, E, 1); \
+	} \
+	cache->state[base + way] = 0; \
+	return write ? storeLine(cache, info, base + way, size, result) : result; \
+}
+
+/*
+ * Drop a block from the cache for policy P, keeping the policy's bookkeeping straight
+ */
+#define DEFINE_INVALIDATE(P) \
+static int P##Invalidate(Cache* cache, cacheInfo info, unsigned long long address) { \
+	size_t setNum = (address >> info.b) & (info.S - 1); \
+	size_t base = setNum * cache->ways; \
+	int way = findLine(cache, info, address, base); \
+	if(way < 0) { \
+		return 0; \
+	} \
+	P##Remove(cache, setNum, way, info.E); \
+	cache->valid[base + way] = 0; \
+	cache->filled[setNum]--; \
+	return cache->state[base + way] & LINE_DIRTY ? 2 : 1; \
+}
+
+#define POLICIES(X) X(lru) X(fifo) X(random) X(plru) X(nru) X(srrip) X(brrip) X(lfu)
+
+#define DEFINE_POLICY(P) \
+	DEFINE_ACCESS(P, 1, 1, Narrow) \
+	DEFINE_ACCESS(P, 2, 2, Narrow) \
+	DEFINE_ACCESS(P, 4, 4, Narrow) \
+	DEFINE_ACCESS(P, Any, 0, Narrow) \
+	DEFINE_ACCESS(P, 1, 1, Wide) \
+	DEFINE_ACCESS(P, 2, 2, Wide) \
+	DEFINE_ACCESS(P, 4, 4, Wide) \
+	DEFINE_ACCESS(P, Any, 0, Wide) \
+	DEFINE_INVALIDATE(P) \
+	static void P##InitAll(Cache* cache, cacheInfo info) { \
+		for(size_t set = 0; set < (size_t) info.S; set++) { \
+			P##Init(cache, set, info.E); \
+		} \
+	}
+
+POLICIES(DEFINE_POLICY)
+
+#define ACCESS_ROW(P) { P##Access1Narrow, P##Access2Narrow, P##Access4Narrow, P##AccessAnyNarrow },
+#define WIDE_ACCESS_ROW(P) { P##Access1Wide, P##Access2Wide, P##Access4Wide, P##AccessAnyWide },
+#define INIT_ENTRY(P) P##InitAll,
+#define INVALIDATE_ENTRY(P) P##Invalidate,
+
+static const accessFn accessTable[NUM_POLICIES][4] = { POLICIES(ACCESS_ROW) }; // indexed by policy, then E = 1, 2, 4 or anything
+static const accessFn wideAccessTable[NUM_POLICIES][4] = { POLICIES(WIDE_ACCESS_ROW) };
+static void (*const initTable[NUM_POLICIES])(Cache*, cacheInfo) = { POLICIES(INIT_ENTRY) };
+static int (*const invalidateTable[NUM_POLICIES])(Cache*, cacheInfo, unsigned long long) = { POLICIES(INVALIDATE_ENTRY) };
+
+int repeatHitsFold(const Cache* cache) {
+	switch(cache->policy) {
+	case POLICY_LFU: return 0;
+	case POLICY_SRRIP: case POLICY_BRRIP: return 2;
+	default: return 1; // a hit on the line just used leaves the rest of these as they were
+	}
+}
+
+unsigned char* lineState(Cache* cache, cacheInfo info, unsigned long long address) {
+	size_t base = ((address >> info.b) & (info.S - 1)) * cache->ways;
+	int way = findLine(cache, info, address, base);
+	return way < 0 ? NULL : &cache->state[base + way];
+}
+
+int invalidateBlock(Cache* cache, cacheInfo info, unsigned long long address) {
+	return invalidateTable[cache->policy](cache, info, address);
+}
+
+int parseWritePolicy(const char* name, int* writeBack, int* writeAllocate) {
+	if(strcmp(name, "wb") == 0) { *writeBack = 1; }
+	else if(strcmp(name, "wt") == 0) { *writeBack = 0; }
+	else if(strcmp(name, "wa") == 0) { *writeAllocate = 1; }
+	else if(strcmp(name, "nwa") == 0) { *writeAllocate = 0; }
+	else { return -1; }
+	return 0;
+}
+
+/*
+ * Round n up to a whole number of 64-byte cache lines
+ */
+static size_t alignUp(size_t n) {
+	return (n + 63) & ~(size_t) 63;
+}
+
+/*
+ * Allocate one aligned arena for all of the lines and sets in the cache
+ */
+Cache* newCache(cacheInfo info, replacementPolicy policy) {
+	if(policy == POLICY_PLRU && (info.E & (info.E - 1)) != 0) {
+		puts("Tree-PLRU needs E to be a power of 2.");
+		return NULL;
+	}
+
+	Cache* cache = (Cache*) malloc(sizeof(Cache));
+	cache->policy = policy;
+	cache->writeBack = 1;
+	cache->writeAllocate = 1;
+	cache->lookup = chooseLookup(info.E);
+	cache->ways = info.E < LOOKUP_WIDTH ? info.E : (info.E + LOOKUP_WIDTH - 1) / LOOKUP_WIDTH * LOOKUP_WIDTH;
+
+	switch(policy) { // how much replacement state each line and set needs
+	case POLICY_LRU: cache->lineWords = 2; cache->setWords = 1; break;
+	case POLICY_PLRU: case POLICY_NRU: cache->lineWords = 0; cache->setWords = BITWORDS(info.E); break;
+	case POLICY_SRRIP: cache->lineWords = 0; cache->setWords = 4 * BITWORDS(info.E); break;
+	case POLICY_BRRIP: cache->lineWords = 0; cache->setWords = 4 * BITWORDS(info.E) + 1; break;
+	case POLICY_LFU: cache->lineWords = 4; cache->setWords = 1; break;
+	default: cache->lineWords = 0; cache->setWords = 1; break;
+	}
+
+	size_t lines = (size_t) info.S * cache->ways;
+	size_t validBytes = alignUp(lines);
+	size_t stateBytes = alignUp(lines);
+	size_t metaBytes = alignUp(lines * cache->lineWords * sizeof(unsigned int));
+	size_t setBytes = alignUp((size_t) info.S * cache->setWords * sizeof(unsigned long long));
+	size_t filledBytes = alignUp(info.S * sizeof(unsigned int));
+
+	// Tags get an allocation of their own so they can be swapped for wider ones
+	const char* tagMode = getenv("CSIM_TAGS");
+	cache->wideTags = tagMode != NULL && strcmp(tagMode, "wide") == 0;
+	cache->tags = NULL;
+	cache->narrowTags = NULL;
+	cache->tagHigh = 0;
+	cache->tagsPinned = 0;
+	void* tagStore = NULL;
+	cache->arena = NULL;
+	size_t tagBytes = alignUp(lines * (cache->wideTags ? sizeof(unsigned long long) : sizeof(unsigned int)));
+	if(posix_memalign(&cache->arena, 64, validBytes + stateBytes + metaBytes + setBytes + filledBytes) != 0
+			|| posix_memalign(&tagStore, 64, tagBytes) != 0) {
+		puts("Out of memory.");
+		free(cache->arena);
+		free(cache);
+		return NULL;
+	}
+	memset(tagStore, 0, tagBytes);
+	if(cache->wideTags) {
+		cache->tags = (unsigned long long*) tagStore;
+	}
+	else {
+		cache->narrowTags = (unsigned int*) tagStore;
+	}
+	cache->setMeta = (unsigned long long*) cache->arena;
+	cache->meta = (unsigned int*) ((char*) cache->setMeta + setBytes);
+	cache->filled = (unsigned int*) ((char*) cache->meta + metaBytes);
+	cache->valid = (unsigned char*) cache->filled + filledBytes;
+	cache->state = cache->valid + validBytes;
+
+	memset(cache->valid, 0, lines);
+	memset(cache->state, 0, lines);
+	memset(cache->meta, 0, lines * cache->lineWords * sizeof(unsigned int));
+	memset(cache->filled, 0, info.S * sizeof(unsigned int));
+	initTable[policy](cache, info);
+
+	int column = info.E == 1 ? 0 : info.E == 2 ? 1 : info.E == 4 ? 2 : 3;
+	cache->access = (cache->wideTags ? wideAccessTable : accessTable)[policy][column];
+	cache->wideAccess = wideAccessTable[policy][column];
+	return cache;
+}
+
+/*
+ * Swap the packed tags for full ones and switch to the wide access routine
+ */
+static void widenTags(Cache* cache, cacheInfo info) {
+	size_t lines = (size_t) info.S * cache->ways;
+	void* wide;
+	if(posix_memalign(&wide, 64, alignUp(lines * sizeof(unsigned long long))) != 0) {
+		puts("Out of memory.");
+		exit(1);
+	}
+	cache->tags = (unsigned long long*) wide;
+	for(size_t i = 0; i < lines; i++) {
+		cache->tags[i] = (cache->tagHigh << 32) | cache->narrowTags[i];
+	}
+	free(cache->narrowTags);
+	cache->narrowTags = NULL;
+	cache->wideTags = 1;
+	cache->access = cache->wideAccess;
+}
+
+void fitTag(Cache* cache, cacheInfo info, unsigned long long address) {
+	unsigned long long high = (address >> (info.s + info.b)) >> 32;
+	if(cache->wideTags || high == cache->tagHigh) {
+		return;
+	}
+	if(!cache->tagsPinned) { // nothing is stored under the old upper bits yet
+		cache->tagHigh = high;
+		return;
+	}
+
+	widenTags(cache, info);
+}
+
+/**
+ * make sure to free all pointers in the Cache
+ */
+void cleanCache(Cache* cache, cacheInfo info) {
+	free(cache->tags);
+	free(cache->narrowTags);
+	free(cache->arena);
+	free(cache);
+}
+
+#define SNAPSHOT_MAGIC 0x50414e534d495343ULL // "CSIMSNAP", which also tells a snapshot from another byte order
+#define SNAPSHOT_VERSION 1
+
+/*
+ * What a snapshot starts with. The arrays follow it in the order saveCache
+ * writes them, each exactly as long as the cache needs: no alignment padding.
+ */
+typedef struct snapshotHeader {
+	unsigned long long magic;
+	unsigned int version;
+	int s, E, b;
+	int policy, writeBack, writeAllocate;
+	int ways, lineWords, setWords; // how this build lays out the arrays
+	int wideTags, tagsPinned;
+	unsigned long long tagHigh;
+	unsigned long long numEvicts, numHits, numMisses, numDirtyEvicts, bytesRead, bytesWritten;
+} snapshotHeader;
+
+static int writeArray(FILE* fp, const void* data, size_t bytes) {
+	return bytes == 0 || fwrite(data, 1, bytes, fp) == bytes ? 0 : -1;
+}
+
+static int readArray(FILE* fp, void* data, size_t bytes) {
+	return bytes == 0 || fread(data, 1, bytes, fp) == bytes ? 0 : -1;
+}
+
+int saveCache(const Cache* cache, cacheInfo info, FILE* fp) {
+	snapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.s = info.s;
+	header.E = info.E;
+	header.b = info.b;
+	header.policy = cache->policy;
+	header.writeBack = cache->writeBack;
+	header.writeAllocate = cache->writeAllocate;
+	header.ways = cache->ways;
+	header.lineWords = cache->lineWords;
+	header.setWords = cache->setWords;
+	header.wideTags = cache->wideTags;
+	header.tagsPinned = cache->tagsPinned;
+	header.tagHigh = cache->tagHigh;
+	header.numEvicts = info.numEvicts;
+	header.numHits = info.numHits;
+	header.numMisses = info.numMisses;
+	header.numDirtyEvicts = info.numDirtyEvicts;
+	header.bytesRead = info.bytesRead;
+	header.bytesWritten = info.bytesWritten;
+
+	size_t lines = (size_t) info.S * cache->ways;
+	int status = writeArray(fp, &header, sizeof(header));
+	if(cache->wideTags) {
+		status |= writeArray(fp, cache->tags, lines * sizeof(unsigned long long));
+	}
+	else {
+		status |= writeArray(fp, cache->narrowTags, lines * sizeof(unsigned int));
+	}
+	status |= writeArray(fp, cache->valid, lines);
+	status |= writeArray(fp, cache->state, lines);
+	status |= writeArray(fp, cache->meta, lines * cache->lineWords * sizeof(unsigned int));
+	status |= writeArray(fp, cache->setMeta, (size_t) info.S * cache->setWords * sizeof(unsigned long long));
+	status |= writeArray(fp, cache->filled, info.S * sizeof(unsigned int));
+	return status;
+}
+
+Cache* loadCache(FILE* fp, cacheInfo* info) {
+	snapshotHeader header;
+	if(readArray(fp, &header, sizeof(header)) != 0 || header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION) {
+		puts("Not a cache snapshot.");
+		return NULL;
+	}
+	if(header.s < 0 || header.s > 30 || header.E < 1 || header.b < 0 || header.b > 63
+			|| header.policy < 0 || header.policy >= NUM_POLICIES) {
+		puts("The snapshot's cache is invalid.");
+		return NULL;
+	}
+
+	memset(info, 0, sizeof(*info));
+	info->s = header.s;
+	info->E = header.E;
+	info->b = header.b;
+	info->S = 1 << header.s;
+	info->B = 1 << header.b;
+	Cache* cache = newCache(*info, (replacementPolicy) header.policy);
+	if(cache == NULL) {
+		return NULL;
+	}
+	if(cache->ways != header.ways || cache->lineWords != header.lineWords || cache->setWords != header.setWords) {
+		puts("The snapshot was made by a build of csim that lays out caches differently.");
+		cleanCache(cache, *info);
+		return NULL;
+	}
+	cache->writeBack = header.writeBack;
+	cache->writeAllocate = header.writeAllocate;
+	cache->tagHigh = header.tagHigh;
+	cache->tagsPinned = header.tagsPinned;
+
+	size_t lines = (size_t) info->S * cache->ways;
+	int status = 0;
+	if(header.wideTags) {
+		if(!cache->wideTags) {
+			widenTags(cache, *info);
+		}
+		status |= readArray(fp, cache->tags, lines * sizeof(unsigned long long));
+	}
+	else if(cache->wideTags) { // CSIM_TAGS=wide, so spread the packed tags out as they're read
+		unsigned int tag;
+		for(size_t i = 0; i < lines && status == 0; i++) {
+			status |= readArray(fp, &tag, sizeof(tag));
+			cache->tags[i] = (cache->tagHigh << 32) | tag;
+		}
+	}
+	else {
+		status |= readArray(fp, cache->narrowTags, lines * sizeof(unsigned int));
+	}
+	status |= readArray(fp, cache->valid, lines);
+	status |= readArray(fp, cache->state, lines);
+	status |= readArray(fp, cache->meta, lines * cache->lineWords * sizeof(unsigned int));
+	status |= readArray(fp, cache->setMeta, (size_t) info->S * cache->setWords * sizeof(unsigned long long));
+	status |= readArray(fp, cache->filled, info->S * sizeof(unsigned int));
+	if(status != 0) {
+		puts("The snapshot is truncated.");
+		cleanCache(cache, *info);
+		return NULL;
+	}
+
+	info->numEvicts = header.numEvicts;
+	info->numHits = header.numHits;
+	info->numMisses = header.numMisses;
+	info->numDirtyEvicts = header.numDirtyEvicts;
+	info->bytesRead = header.bytesRead;
+	info->bytesWritten = header.bytesWritten;
+	return cache;
+}
@@ -0,0 +1,197 @@
+/*
+ * cache.h - The set-associative cache engine behind csim
+ *
+ * A Cache keeps every set in one aligned arena of separate arrays (valid
+ * bits, line state and replacement metadata) plus an array of tags. Each replacement policy
+ * gets its own access routine, specialized at compile time for small E, and
+ * newCache picks the right one so the hot loop never branches on policy.
+ *
+ * Stores follow the cache's write policy: write-back caches mark the line
+ * dirty and write it out when it's evicted, write-through caches send every
+ * store on to the next level, and a no-write-allocate cache sends a store
+ * that misses on without filling a line. The counters in cacheInfo track the
+ * bytes that move between the cache and the next level either way.
+ *
+ * Tags start out packed into 32 bits, with the bits above them kept once
+ * for the whole cache, which holds any trace whose addresses stay within
+ * one 2^(32+s+b) byte window at half the memory. The first fill whose tag
+ * needs other upper bits widens every tag to 64 bits for the rest of the
+ * run. Setting CSIM_TAGS to "wide" starts out wide.
+ *
+ * saveCache and loadCache write a cache's whole state to a snapshot and
+ * read it back, which is what csim's checkpoints (-S and -R) are made of.
+ */
+#ifndef CACHELAB_CACHE_H
+#define CACHELAB_CACHE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "lookup.h"
+
+typedef struct info {
+	unsigned long long numEvicts; // the number of cache evictions
+	unsigned long long numHits; // the number of cache hits
+	unsigned long long numMisses; // the number of cache misses
+	unsigned long long numDirtyEvicts; // evictions that had to write the line back
+	unsigned long long bytesRead; // bytes filled from the next level
+	unsigned long long bytesWritten; // bytes written to the next level
+	int E; // the lines in the set
+	int S; // the number of sets
+	int s; // 2^s sets
+	int B; // the bytes in the cache "payload"
+	int b; // 2^e bytes per block
+} cacheInfo;
+
+typedef enum policy {
+	POLICY_LRU, // evict the least recently used line
+	POLICY_FIFO, // evict lines in the order they were filled
+	POLICY_RANDOM, // evict any line
+	POLICY_PLRU, // tree pseudo-LRU (E must be a power of 2)
+	POLICY_NRU, // evict a line not used since the last time every line was
+	POLICY_SRRIP, // static re-reference interval prediction, 2-bit
+	POLICY_BRRIP, // bimodal RRIP: most fills are predicted distant
+	POLICY_LFU, // evict the least frequently used line, oldest first on ties
+	NUM_POLICIES
+} replacementPolicy;
+
+typedef struct cache Cache;
+
+/* What is being asked of the cache */
+#define REQUEST_READ 0 /* a load (or instruction fetch) */
+#define REQUEST_WRITE 1 /* a store */
+#define REQUEST_INSTALL 2 /* place a clean block from the level above; not a hit or a miss */
+#define REQUEST_WRITEBACK 3 /* place a dirty block from the level above; not a hit or a miss */
+#define REQUEST_PREFETCH 4 /* fill a block from the next level nobody asked for yet; not a hit or a miss */
+
+/* Bits of a line's state byte. The engine only uses LINE_DIRTY and LINE_PREFETCHED and clears them all on a fill. */
+#define LINE_DIRTY 1 /* the line differs from the next level */
+#define LINE_SHARED 2 /* another cache may hold the block too (kept by coherence.c) */
+#define LINE_PREFETCHED 4 /* a prefetch filled the line and no demand access has used it (kept by prefetch.c) */
+
+/* What an access did */
+#define ACCESS_HIT 0
+#define ACCESS_MISS 1
+#define ACCESS_EVICT 2 /* set along with ACCESS_MISS when a valid line was replaced */
+#define ACCESS_DIRTY 4 /* set along with ACCESS_EVICT when the replaced line was written back */
+#define ACCESS_FILL 8 /* the block was read from the next level */
+#define ACCESS_FORWARD 16 /* the stored bytes went on to the next level */
+#define ACCESS_UNUSED 32 /* set along with ACCESS_EVICT when the replaced line was LINE_PREFETCHED */
+
+typedef int (*accessFn)(Cache* cache, cacheInfo* info, unsigned long long address, int request, unsigned int size, int verbose, unsigned long long* evicted);
+
+/*
+ * Line i of set n is entry n * ways + i of tags and valid. Policies keep
+ * lineWords words per line in meta (word w of line i in set n is
+ * meta[(n * lineWords + w) * ways + i]) and setWords words per set in setMeta.
+ */
+struct cache {
+	unsigned long long* tags; // the tag of each line, once they're wide
+	unsigned int* narrowTags; // the low 32 bits of each line's tag, while they're packed
+	unsigned long long tagHigh; // the tag bits above those, the same for every packed line
+	int wideTags; // whether tags has replaced narrowTags
+	int tagsPinned; // whether anything has been filled under tagHigh
+	unsigned char* valid; // the valid bit of each line
+	unsigned char* state; // LINE_DIRTY and LINE_SHARED bits for each line
+	unsigned int* meta; // per line replacement state
+	unsigned long long* setMeta; // per set replacement state
+	unsigned int* filled; // the number of valid lines in each set
+	int ways; // lines stored per set: E, padded to LOOKUP_WIDTH for the vector kernels
+	int lineWords; // words of meta per line
+	int setWords; // words of setMeta per set
+	replacementPolicy policy; // how victims are chosen
+	int writeBack; // hold stores until eviction (1, the default) or write them through (0)
+	int writeAllocate; // fill a line on a store miss (1, the default) or write around it (0)
+	lookupOps lookup; // the set searches picked for this CPU
+	accessFn access; // processCache specialized for this policy, E and tag width
+	accessFn wideAccess; // the same for wide tags, which access becomes when they widen
+	void* arena; // the one allocation behind all of the arrays above
+};
+
+/* The policy called name (as given to -p), or -1 if there isn't one */
+int parsePolicy(const char* name);
+
+/* The name of a policy */
+const char* policyName(replacementPolicy policy);
+
+/*
+ * parseWritePolicy - Apply a write policy name (as given to -w and in hierarchy
+ *     descriptions: wb, wt, wa or nwa). Returns -1 if there isn't one.
+ */
+int parseWritePolicy(const char* name, int* writeBack, int* writeAllocate);
+
+/* Allocate an empty write-back, write-allocate cache, or print why not and return NULL */
+Cache* newCache(cacheInfo info, replacementPolicy policy);
+
+/* Free everything newCache allocated */
+void cleanCache(Cache* cache, cacheInfo info);
+
+/*
+ * saveCache - Write everything about the cache to fp as a snapshot: its
+ *     geometry and policies, every line's tag, valid bit and state, the
+ *     replacement state (random generators included) and info's counters.
+ *     Returns 0, or -1 if the write failed.
+ */
+int saveCache(const Cache* cache, cacheInfo info, FILE* fp);
+
+/*
+ * loadCache - Rebuild a cache from a snapshot saveCache wrote, with its
+ *     geometry and counters in *info. Accesses then go exactly as they would
+ *     have in the saved cache. Prints why and returns NULL if it can't.
+ */
+Cache* loadCache(FILE* fp, cacheInfo* info);
+
+/*
+ * accessCache - Run one request for size bytes at address and update the
+ *     counters in info. Returns ACCESS_HIT or ACCESS_MISS, plus ACCESS_EVICT if
+ *     a valid line was replaced (*evicted is then the address of the block that
+ *     left) and ACCESS_DIRTY, ACCESS_FILL and ACCESS_FORWARD for the traffic it
+ *     caused. With verbose set it prints hit/miss/eviction.
+ */
+static inline int accessCache(Cache* cache, cacheInfo* info, unsigned long long address, int request, unsigned int size, int verbose, unsigned long long* evicted) {
+	return cache->access(cache, info, address, request, size, verbose, evicted);
+}
+
+/*
+ * processCache - Run one request, update the counters in info and return them
+ */
+static inline cacheInfo processCache(Cache* cache, cacheInfo info, unsigned long long address, int request, unsigned int size, int verbose) {
+	unsigned long long evicted;
+	cache->access(cache, &info, address, request, size, verbose, &evicted);
+	return info;
+}
+
+/*
+ * tagFits - Whether address's tag can be stored the way the cache stores
+ *     tags now. Accesses that don't fit call fitTag themselves; the only
+ *     caller that needs to ask first is one sharing the cache between
+ *     threads, which has to fit the tag while no other thread is using it.
+ */
+static inline int tagFits(const Cache* cache, cacheInfo info, unsigned long long address) {
+	return cache->wideTags || ((address >> (info.s + info.b)) >> 32) == cache->tagHigh;
+}
+
+/* fitTag - Let the cache hold address's tag: adopt its upper bits if nothing's been filled yet, or widen every tag */
+void fitTag(Cache* cache, cacheInfo info, unsigned long long address);
+
+/*
+ * repeatHitsFold - How many accesses in a row to one block, starting with
+ *     the one that left it in the cache, it takes before every further
+ *     demand access to it is a hit that changes nothing in the cache: 1 for
+ *     most policies, 2 for RRIP (the first re-reference still promotes a
+ *     filled line) and 0 for LFU, which counts every use.
+ */
+int repeatHitsFold(const Cache* cache);
+
+/*
+ * lineState - The state byte of the line holding address, or NULL if it isn't cached
+ */
+unsigned char* lineState(Cache* cache, cacheInfo info, unsigned long long address);
+
+/*
+ * invalidateBlock - Drop the block holding address if it's cached, without
+ *     touching the counters. Returns 0 if it wasn't cached, 1 if it was and
+ *     2 if it was dirty.
+ */
+int invalidateBlock(Cache* cache, cacheInfo info, unsigned long long address);
+
+#endif /* CACHELAB_CACHE_H */
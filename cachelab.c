@@ -14,15 +14,36 @@ int func_counter = 0;
  * printSummary - Summarize the cache simulation statistics. Student cache simulators
  *                must call this function in order to be properly autograded. 
  */
-void printSummary(int hits, int misses, int evictions)
+void printSummary(unsigned long long hits, unsigned long long misses, unsigned long long evictions)
 {
-    printf("hits:%d misses:%d evictions:%d\n", hits, misses, evictions);
+    printf("hits:%llu misses:%llu evictions:%llu\n", hits, misses, evictions);
     FILE* output_fp = fopen(".csim_results", "w");
     assert(output_fp);
-    fprintf(output_fp, "%d %d %d\n", hits, misses, evictions);
+    fprintf(output_fp, "%llu %llu %llu\n", hits, misses, evictions);
     fclose(output_fp);
 }
 
+/*
+ * printLevelSummary - Summarize one level of a multi-level simulation
+ */
+void printLevelSummary(const char* level, unsigned long long hits,
+                       unsigned long long misses, unsigned long long evictions)
+{
+    printf("%s hits:%llu misses:%llu evictions:%llu\n", level, hits, misses, evictions);
+}
+
+/*
+ * printTrafficSummary - Summarize the memory traffic of a simulation
+ */
+void printTrafficSummary(const char* level, unsigned long long dirtyEvictions,
+                         unsigned long long bytesRead, unsigned long long bytesWritten)
+{
+    if (level != NULL)
+        printf("%s ", level);
+    printf("dirty-evictions:%llu bytes-read:%llu bytes-written:%llu\n",
+           dirtyEvictions, bytesRead, bytesWritten);
+}
+
 /* 
  * initMatrix - Initialize the given matrix 
  */
@@ -5,24 +5,73 @@
 #ifndef CACHELAB_TOOLS_H
 #define CACHELAB_TOOLS_H
 
+#include "trace.h"
+
 #define MAX_TRANS_FUNCS 100
 
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
   char* description;
   char correct;
-  unsigned int num_hits;
-  unsigned int num_misses;
-  unsigned int num_evictions;
+  unsigned long long num_hits;
+  unsigned long long num_misses;
+  unsigned long long num_evictions;
 } trans_func_t;
 
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
  */ 
-void printSummary(int hits,  /* number of  hits */
-				  int misses, /* number of misses */
-				  int evictions); /* number of evictions */
+void printSummary(unsigned long long hits,  /* number of  hits */
+				  unsigned long long misses, /* number of misses */
+				  unsigned long long evictions); /* number of evictions */
+
+/*
+ * printLevelSummary - printSummary for one level of a cache hierarchy,
+ * tagged with the level's name. It only prints to stdout.
+ */
+void printLevelSummary(const char* level, /* name of the level */
+                       unsigned long long hits, unsigned long long misses,
+                       unsigned long long evictions);
+
+/*
+ * printTrafficSummary - Report the traffic between a cache and the next
+ * level, tagged with the level's name unless it's NULL. It only prints to stdout.
+ */
+void printTrafficSummary(const char* level, /* name of the level, or NULL */
+                         unsigned long long dirtyEvictions, /* evictions that wrote a line back */
+                         unsigned long long bytesRead, /* bytes filled from below */
+                         unsigned long long bytesWritten); /* bytes written below */
+
+/*
+ * An in-process LRU cache simulator, for evaluating traces without running
+ * csim. Each one is independent, so several can run side by side.
+ */
+typedef struct cache_sim cache_sim_t;
+
+typedef struct cache_stats {
+  unsigned long long hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  unsigned long long dirty_evictions;
+  unsigned long long bytes_read;    /* bytes filled from memory */
+  unsigned long long bytes_written; /* bytes written back to memory */
+} cache_stats_t;
+
+/* Create an empty cache with 2^s sets of E lines of 2^b bytes, or NULL */
+cache_sim_t* newCacheSim(int s, int E, int b);
+
+/* Simulate one L, S or M access (anything else is ignored) */
+void cacheSimAccess(cache_sim_t* sim, char op, unsigned long long addr, unsigned int len);
+
+/* Simulate a batch of trace records in order */
+void cacheSimRecords(cache_sim_t* sim, const traceRecord* recs, unsigned int count);
+
+/* The counters so far */
+cache_stats_t cacheSimStats(const cache_sim_t* sim);
+
+/* Free the simulator */
+void freeCacheSim(cache_sim_t* sim);
 
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
@@ -34,4 +83,10 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* 
+ * registerTunedFunctions - Register the transpose transtune wrote to
+ * trans-tuned.c. It's weak, so it's NULL unless that file is linked in.
+ */
+void registerTunedFunctions() __attribute__((weak));
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,90 @@
+/*
+ * cachesim.c - The in-process cache simulator declared in cachelab.h
+ *
+ * It lives apart from cachelab.c so programs that only need the helpers
+ * (tracegen in particular) don't link the cache engine, which would move
+ * their globals around and with them the addresses valgrind traces.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cachelab.h"
+#include "cache.h"
+
+struct cache_sim {
+    Cache* cache;
+    cacheInfo info;
+};
+
+/*
+ * newCacheSim - Create a write-back, write-allocate LRU cache
+ */
+cache_sim_t* newCacheSim(int s, int E, int b)
+{
+    cache_sim_t* sim = malloc(sizeof(cache_sim_t));
+    memset(&sim->info, 0, sizeof(sim->info));
+    sim->info.s = s;
+    sim->info.E = E;
+    sim->info.b = b;
+    sim->info.S = 1 << s;
+    sim->info.B = 1 << b;
+    sim->cache = newCache(sim->info, POLICY_LRU);
+    if (sim->cache == NULL) {
+        free(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+/*
+ * cacheSimAccess - Simulate one access, the same way csim does
+ */
+void cacheSimAccess(cache_sim_t* sim, char op, unsigned long long addr, unsigned int len)
+{
+    unsigned long long evicted;
+    switch (op) {
+    case 'M': /* a load and then a store */
+        accessCache(sim->cache, &sim->info, addr, REQUEST_READ, len, 0, &evicted);
+        accessCache(sim->cache, &sim->info, addr, REQUEST_WRITE, len, 0, &evicted);
+        break;
+    case 'L':
+        accessCache(sim->cache, &sim->info, addr, REQUEST_READ, len, 0, &evicted);
+        break;
+    case 'S':
+        accessCache(sim->cache, &sim->info, addr, REQUEST_WRITE, len, 0, &evicted);
+        break;
+    }
+}
+
+/*
+ * cacheSimRecords - Simulate a batch of records
+ */
+void cacheSimRecords(cache_sim_t* sim, const traceRecord* recs, unsigned int count)
+{
+    unsigned int i;
+    for (i = 0; i < count; i++)
+        cacheSimAccess(sim, recs[i].op, recs[i].address, recs[i].len);
+}
+
+/*
+ * cacheSimStats - Read the counters
+ */
+cache_stats_t cacheSimStats(const cache_sim_t* sim)
+{
+    cache_stats_t stats;
+    stats.hits = sim->info.numHits;
+    stats.misses = sim->info.numMisses;
+    stats.evictions = sim->info.numEvicts;
+    stats.dirty_evictions = sim->info.numDirtyEvicts;
+    stats.bytes_read = sim->info.bytesRead;
+    stats.bytes_written = sim->info.bytesWritten;
+    return stats;
+}
+
+/*
+ * freeCacheSim - Free the cache and the simulator
+ */
+void freeCacheSim(cache_sim_t* sim)
+{
+    cleanCache(sim->cache, sim->info);
+    free(sim);
+}
@@ -0,0 +1,226 @@
+/*
+ * classify.c - Compulsory, capacity and conflict misses
+ *
+ * The shadow cache's lines live in one array. Each is on its bucket's chain
+ * and on the recency list at once, so a lookup, a move to the front and an
+ * LRU replacement are all constant time. Blocks ever touched go in a
+ * separate open-addressed set that only grows.
+ */
+#include "classify.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NONE 0xffffffffu // an empty link or bucket
+
+static const char* classNames[] = { "hit", "compulsory", "capacity", "conflict" };
+
+static size_t hashBlock(unsigned long long block, size_t capacity) {
+	return ((block * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+}
+
+missClassifier* newClassifier(cacheInfo info, int writeAllocate) {
+	missClassifier* classifier = (missClassifier*) calloc(1, sizeof(missClassifier));
+	if(classifier == NULL) {
+		return NULL;
+	}
+	classifier->b = info.b;
+	classifier->writeAllocate = writeAllocate;
+	classifier->numLines = (unsigned int) info.S * info.E;
+	classifier->numBuckets = 1;
+	while(classifier->numBuckets < 2 * classifier->numLines) {
+		classifier->numBuckets *= 2;
+	}
+	classifier->lines = (shadowLine*) malloc(classifier->numLines * sizeof(shadowLine));
+	classifier->buckets = (unsigned int*) malloc(classifier->numBuckets * sizeof(unsigned int));
+	classifier->seenCapacity = 1024;
+	classifier->seen = (unsigned long long*) calloc(classifier->seenCapacity, sizeof(unsigned long long));
+	if(classifier->lines == NULL || classifier->buckets == NULL || classifier->seen == NULL) {
+		printf("Couldn't allocate the shadow cache.\n");
+		cleanClassifier(classifier);
+		return NULL;
+	}
+	for(unsigned int i = 0; i < classifier->numBuckets; i++) {
+		classifier->buckets[i] = NONE;
+	}
+	classifier->head = classifier->tail = NONE;
+	return classifier;
+}
+
+void startRegion(missClassifier* classifier) {
+	if(classifier->numRegions == classifier->regionCapacity) {
+		classifier->regionCapacity = classifier->regionCapacity ? 2 * classifier->regionCapacity : 16;
+		classifier->regions = (missCounts*) realloc(classifier->regions, classifier->regionCapacity * sizeof(missCounts));
+	}
+	missCounts* region = &classifier->regions[classifier->numRegions++];
+	region->compulsory = region->capacity = region->conflict = 0;
+}
+
+/*
+ * Add a block to the touched set. Returns 1 if it was already there.
+ */
+static int touch(missClassifier* classifier, unsigned long long block) {
+	unsigned long long key = block + 1;
+	size_t i = hashBlock(block, classifier->seenCapacity);
+
+	for(; classifier->seen[i] != 0; i = (i + 1) & (classifier->seenCapacity - 1)) {
+		if(classifier->seen[i] == key) {
+			return 1;
+		}
+	}
+
+	if(2 * (classifier->numSeen + 1) > classifier->seenCapacity) { // keep the set at most half full
+		unsigned long long* old = classifier->seen;
+		size_t oldCapacity = classifier->seenCapacity;
+		classifier->seenCapacity *= 2;
+		classifier->seen = (unsigned long long*) calloc(classifier->seenCapacity, sizeof(unsigned long long));
+		for(size_t j = 0; j < oldCapacity; j++) {
+			if(old[j] != 0) {
+				size_t k = hashBlock(old[j] - 1, classifier->seenCapacity);
+				while(classifier->seen[k] != 0) {
+					k = (k + 1) & (classifier->seenCapacity - 1);
+				}
+				classifier->seen[k] = old[j];
+			}
+		}
+		free(old);
+		i = hashBlock(block, classifier->seenCapacity);
+		while(classifier->seen[i] != 0) {
+			i = (i + 1) & (classifier->seenCapacity - 1);
+		}
+	}
+	classifier->seen[i] = key;
+	classifier->numSeen++;
+	return 0;
+}
+
+/*
+ * Recency list and bucket chain helpers for the shadow cache
+ */
+static void unlinkLine(missClassifier* classifier, unsigned int i) {
+	shadowLine* line = &classifier->lines[i];
+	if(line->prev != NONE) {
+		classifier->lines[line->prev].next = line->next;
+	}
+	else {
+		classifier->head = line->next;
+	}
+	if(line->next != NONE) {
+		classifier->lines[line->next].prev = line->prev;
+	}
+	else {
+		classifier->tail = line->prev;
+	}
+}
+
+static void pushFront(missClassifier* classifier, unsigned int i) {
+	shadowLine* line = &classifier->lines[i];
+	line->prev = NONE;
+	line->next = classifier->head;
+	if(classifier->head != NONE) {
+		classifier->lines[classifier->head].prev = i;
+	}
+	else {
+		classifier->tail = i;
+	}
+	classifier->head = i;
+}
+
+static void unchainLine(missClassifier* classifier, unsigned int i) {
+	unsigned int* link = &classifier->buckets[hashBlock(classifier->lines[i].block, classifier->numBuckets)];
+	while(*link != i) {
+		link = &classifier->lines[*link].chain;
+	}
+	*link = classifier->lines[i].chain;
+}
+
+/*
+ * Look a block up in the shadow cache, making it the most recently used line.
+ * On a miss it replaces the LRU line if allocate is set. Returns 1 on a hit.
+ */
+static int shadowAccess(missClassifier* classifier, unsigned long long block, int allocate) {
+	unsigned int* bucket = &classifier->buckets[hashBlock(block, classifier->numBuckets)];
+	unsigned int i;
+
+	for(i = *bucket; i != NONE; i = classifier->lines[i].chain) {
+		if(classifier->lines[i].block == block) {
+			if(classifier->head != i) {
+				unlinkLine(classifier, i);
+				pushFront(classifier, i);
+			}
+			return 1;
+		}
+	}
+	if(!allocate) {
+		return 0;
+	}
+
+	if(classifier->used < classifier->numLines) {
+		i = classifier->used++;
+	}
+	else {
+		i = classifier->tail;
+		unlinkLine(classifier, i);
+		unchainLine(classifier, i);
+	}
+	classifier->lines[i].block = block;
+	classifier->lines[i].chain = *bucket;
+	*bucket = i;
+	pushFront(classifier, i);
+	return 0;
+}
+
+int classifyAccess(missClassifier* classifier, unsigned long long address, int request, int result) {
+	if(request != REQUEST_READ && request != REQUEST_WRITE) {
+		return MISS_NONE;
+	}
+
+	unsigned long long block = address >> classifier->b;
+	int touched = touch(classifier, block);
+	int shadowHit = shadowAccess(classifier, block, request == REQUEST_READ || classifier->writeAllocate);
+	if(!(result & ACCESS_MISS)) {
+		return MISS_NONE;
+	}
+
+	int missClass = !touched ? MISS_COMPULSORY : shadowHit ? MISS_CONFLICT : MISS_CAPACITY;
+	missCounts* region = classifier->numRegions > 0 ? &classifier->regions[classifier->numRegions - 1] : NULL;
+	switch(missClass) {
+	case MISS_COMPULSORY:
+		classifier->total.compulsory++;
+		if(region != NULL) { region->compulsory++; }
+		break;
+	case MISS_CAPACITY:
+		classifier->total.capacity++;
+		if(region != NULL) { region->capacity++; }
+		break;
+	default:
+		classifier->total.conflict++;
+		if(region != NULL) { region->conflict++; }
+		break;
+	}
+	return missClass;
+}
+
+const char* missClassName(int missClass) {
+	return classNames[missClass];
+}
+
+void printClassSummary(missClassifier* classifier, const char* level) {
+	const char* space = level != NULL ? " " : "";
+	if(level == NULL) {
+		level = "";
+	}
+	printf("%s%scompulsory:%llu capacity:%llu conflict:%llu\n", level, space,
+			classifier->total.compulsory, classifier->total.capacity, classifier->total.conflict);
+	for(int i = 0; i < classifier->numRegions; i++) {
+		printf("%s%sregion %d compulsory:%llu capacity:%llu conflict:%llu\n", level, space, i,
+				classifier->regions[i].compulsory, classifier->regions[i].capacity, classifier->regions[i].conflict);
+	}
+}
+
+void cleanClassifier(missClassifier* classifier) {
+	free(classifier->lines);
+	free(classifier->buckets);
+	free(classifier->seen);
+	free(classifier->regions);
+	free(classifier);
+}
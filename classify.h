@@ -0,0 +1,78 @@
+/*
+ * classify.h - Sorting a cache's misses into the three Cs for csim
+ *
+ * A miss on a block the trace has never touched before is compulsory. Any
+ * other miss is a capacity miss when a fully associative LRU cache with the
+ * same number of lines would have missed too, and a conflict miss when it
+ * would have hit. The shadow cache is a hash table of its blocks threaded on
+ * an intrusive recency list, so each access costs O(1).
+ *
+ * Counts are kept for the whole trace and for each marker region: every
+ * call to startRegion begins a new one.
+ */
+#ifndef CACHELAB_CLASSIFY_H
+#define CACHELAB_CLASSIFY_H
+
+#include "cache.h"
+
+/* What classifyAccess says a miss was */
+#define MISS_NONE 0 /* the access hit */
+#define MISS_COMPULSORY 1
+#define MISS_CAPACITY 2
+#define MISS_CONFLICT 3
+
+typedef struct missCounts {
+	unsigned long long compulsory; // first touches of a block
+	unsigned long long capacity; // misses a fully associative cache has too
+	unsigned long long conflict; // misses only the real cache's mapping causes
+} missCounts;
+
+typedef struct shadowLine {
+	unsigned long long block; // the block number held
+	unsigned int prev; // toward the most recently used line
+	unsigned int next; // toward the least recently used line
+	unsigned int chain; // the next line in the same hash bucket
+} shadowLine;
+
+typedef struct classifier {
+	int b; // block bits of the real cache
+	int writeAllocate; // store misses fill the shadow as they do the real cache
+	shadowLine* lines; // the shadow cache's lines, S * E of them
+	unsigned int* buckets; // the first line in each bucket
+	unsigned int numBuckets; // a power of 2
+	unsigned int numLines; // lines in the shadow cache
+	unsigned int used; // lines filled so far
+	unsigned int head; // the most recently used line
+	unsigned int tail; // the least recently used line
+	unsigned long long* seen; // open-addressed set of touched blocks (block + 1, 0 is empty)
+	size_t seenCapacity; // slots in seen (a power of 2)
+	size_t numSeen; // slots in use
+	missCounts total;
+	missCounts* regions; // one entry per startRegion call
+	int numRegions;
+	int regionCapacity;
+} missClassifier;
+
+/* A classifier for a cache of this geometry and write-allocate policy, or NULL if it can't be allocated */
+missClassifier* newClassifier(cacheInfo info, int writeAllocate);
+
+/* Count the misses from here on in a new region too */
+void startRegion(missClassifier* classifier);
+
+/*
+ * classifyAccess - Run one request through the shadow cache and, when result
+ *     (what accessCache returned for it) is a miss, count and return its
+ *     class. Installs and writebacks from other levels aren't classified.
+ */
+int classifyAccess(missClassifier* classifier, unsigned long long address, int request, int result);
+
+/* The word verbose output uses for a class */
+const char* missClassName(int missClass);
+
+/* Print the overall counts, prefixed by level unless it's NULL, and then each region's */
+void printClassSummary(missClassifier* classifier, const char* level);
+
+/* Free the shadow cache and the region counts */
+void cleanClassifier(missClassifier* classifier);
+
+#endif /* CACHELAB_CLASSIFY_H */
@@ -0,0 +1,342 @@
+/*
+ * coherence.c - Snooping MESI/MOESI over per-core private caches
+ *
+ * The private caches are ordinary write-back Caches; a line's MOESI state is
+ * its LINE_DIRTY and LINE_SHARED bits (M dirty, O dirty and shared, E clean,
+ * S clean and shared, I not cached). Each access snoops the other cores
+ * first, then runs through the core's own cache, so the hit, miss and
+ * eviction counts mean exactly what they do for a single cache.
+ */
+#include "coherence.h"
+#include "cachelab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* protocolNames[] = { "mesi", "moesi" };
+
+int parseProtocol(const char* name) {
+	for(int i = 0; i <= PROTOCOL_MOESI; i++) {
+		if(strcmp(name, protocolNames[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * The bytes of a block an access touches, one bit per B/64 bytes
+ */
+static unsigned long long byteMask(cacheInfo info, unsigned long long address, unsigned int len) {
+	int shift = info.b > 6 ? info.b - 6 : 0; // blocks past 64 bytes get coarser bits
+	unsigned long long first = address & (info.B - 1);
+	unsigned long long last = first + (len > 0 ? len : 1) - 1;
+	if(last >= (unsigned long long) info.B) {
+		last = info.B - 1; // only the part in this block
+	}
+	int lo = first >> shift, hi = last >> shift;
+	return (hi == 63 ? ~0ULL : (1ULL << (hi + 1)) - 1) & ~((1ULL << lo) - 1);
+}
+
+static size_t hashBlock(unsigned long long block, size_t capacity) {
+	return ((block * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+}
+
+/*
+ * The stats for a block, adding them if create is set and they aren't there yet (NULL otherwise)
+ */
+static lineStats* findLineStats(coherentSystem* sys, unsigned long long block, int create) {
+	unsigned long long key = block + 1;
+	size_t i = hashBlock(block, sys->lineCapacity);
+
+	for(; sys->lines[i].key != 0; i = (i + 1) & (sys->lineCapacity - 1)) {
+		if(sys->lines[i].key == key) {
+			return &sys->lines[i];
+		}
+	}
+	if(!create) {
+		return NULL;
+	}
+
+	if(2 * (sys->numLines + 1) > sys->lineCapacity) { // keep the table at most half full
+		lineStats* old = sys->lines;
+		size_t oldCapacity = sys->lineCapacity;
+		sys->lineCapacity *= 2;
+		sys->lines = (lineStats*) calloc(sys->lineCapacity, sizeof(lineStats));
+		for(size_t j = 0; j < oldCapacity; j++) {
+			if(old[j].key != 0) {
+				size_t k = hashBlock(old[j].key - 1, sys->lineCapacity);
+				while(sys->lines[k].key != 0) {
+					k = (k + 1) & (sys->lineCapacity - 1);
+				}
+				sys->lines[k] = old[j];
+			}
+		}
+		free(old);
+		i = hashBlock(block, sys->lineCapacity);
+		while(sys->lines[i].key != 0) {
+			i = (i + 1) & (sys->lineCapacity - 1);
+		}
+	}
+
+	lineStats* line = &sys->lines[i];
+	line->key = key;
+	line->written = (unsigned long long*) calloc(sys->numCores, sizeof(unsigned long long));
+	sys->numLines++;
+	return line;
+}
+
+/*
+ * Write a block from a private cache back to the shared level
+ */
+static void writeBackShared(coherentSystem* sys, unsigned long long address, unsigned int size) {
+	unsigned long long victim;
+	if(sys->llc != NULL) {
+		accessCache(sys->llc, &sys->llcInfo, address, REQUEST_WRITEBACK, size, 0, &victim);
+	}
+}
+
+/*
+ * Take a block away from every other core ahead of a store. Returns 1 if one of them held it dirty.
+ */
+static int invalidatePeers(coherentSystem* sys, int c, unsigned long long address) {
+	unsigned long long block = address >> sys->cores[c].info.b;
+	int dirty = 0;
+
+	for(int o = 0; o < sys->numCores; o++) {
+		coreState* peer = &sys->cores[o];
+		int state = o == c ? 0 : invalidateBlock(peer->cache, peer->info, address);
+		if(state == 0) {
+			continue;
+		}
+		dirty |= state == 2; // the dirty data goes straight to the new owner
+		peer->invalidations++;
+		lineStats* line = findLineStats(sys, block, 1);
+		line->invalidations++;
+		line->invalidated |= 1ULL << o;
+		line->written[o] = 0; // the store itself is noted once it's done
+	}
+	return dirty;
+}
+
+/*
+ * Snoop every other core for a readable copy of a block. Returns 1 if the
+ * block is shared afterwards, plus 2 if a dirty owner supplied it.
+ */
+static int snoopRead(coherentSystem* sys, int c, unsigned long long address) {
+	int result = 0;
+
+	for(int o = 0; o < sys->numCores; o++) {
+		unsigned char* state = o == c ? NULL : lineState(sys->cores[o].cache, sys->cores[o].info, address);
+		if(state == NULL) {
+			continue;
+		}
+		result |= 1;
+		if(*state & LINE_DIRTY) {
+			result |= 2;
+			if(sys->protocol == PROTOCOL_MESI) { // M goes to S, so memory has to catch up
+				*state &= ~LINE_DIRTY;
+				writeBackShared(sys, address, sys->cores[o].info.B);
+			}
+		}
+		*state |= LINE_SHARED; // E and M become S, or O under MOESI
+	}
+	return result;
+}
+
+/*
+ * Count a miss as a coherence miss if another core's store took the block
+ * away, and as false sharing if nothing written since overlaps this access
+ */
+static void classifyMiss(coherentSystem* sys, int c, unsigned long long block, unsigned long long mask) {
+	lineStats* line = findLineStats(sys, block, 0);
+	if(line == NULL || !(line->invalidated & (1ULL << c))) {
+		return;
+	}
+	line->invalidated &= ~(1ULL << c);
+	line->coherenceMisses++;
+	sys->cores[c].coherenceMisses++;
+	if(!(line->written[c] & mask)) {
+		line->falseSharing++;
+		sys->cores[c].falseSharing++;
+	}
+}
+
+/*
+ * Remember which bytes a store wrote for every core waiting to miss on the block
+ */
+static void noteWrite(coherentSystem* sys, int c, unsigned long long block, unsigned long long mask) {
+	lineStats* line = findLineStats(sys, block, 0);
+	if(line == NULL) {
+		return;
+	}
+	for(unsigned long long waiting = line->invalidated & ~(1ULL << c); waiting; waiting &= waiting - 1) {
+		line->written[__builtin_ctzll(waiting)] |= mask;
+	}
+}
+
+/*
+ * One load or store on a core: snoop, then run it through the core's cache
+ */
+static void coherentAccess(coherentSystem* sys, int c, unsigned long long address, int request, unsigned int len) {
+	coreState* core = &sys->cores[c];
+	unsigned long long block = address >> core->info.b;
+	unsigned long long mask = byteMask(core->info, address, len);
+	unsigned char* state = lineState(core->cache, core->info, address);
+	int write = request == REQUEST_WRITE;
+	int shared = 0;
+
+	if(state == NULL) {
+		int supplied;
+		classifyMiss(sys, c, block, mask);
+		if(write) { // read for ownership
+			sys->busUpgrades++;
+			supplied = invalidatePeers(sys, c, address);
+		}
+		else {
+			sys->busReads++;
+			int snoop = snoopRead(sys, c, address);
+			shared = snoop & 1;
+			supplied = snoop >> 1;
+		}
+		if(supplied) {
+			sys->transfers++;
+		}
+		else if(sys->llc != NULL) {
+			unsigned long long victim;
+			accessCache(sys->llc, &sys->llcInfo, address, REQUEST_READ, core->info.B, 0, &victim);
+		}
+	}
+	else if(write && (*state & LINE_SHARED)) { // S or O has to become M first
+		sys->busUpgrades++;
+		invalidatePeers(sys, c, address);
+	}
+
+	unsigned long long victim;
+	int result = accessCache(core->cache, &core->info, address, request, len, 0, &victim);
+	if(result & ACCESS_DIRTY) {
+		writeBackShared(sys, victim, core->info.B);
+	}
+
+	state = lineState(core->cache, core->info, address);
+	if(write) {
+		*state &= ~LINE_SHARED; // nobody else has it now
+		noteWrite(sys, c, block, mask);
+	}
+	else if(shared) {
+		*state |= LINE_SHARED;
+	}
+}
+
+void coherentRecord(coherentSystem* sys, int core, const traceRecord* rec) {
+	switch(rec->op) {
+	case 'M': // a load and then a store
+		coherentAccess(sys, core, rec->address, REQUEST_READ, rec->len);
+		coherentAccess(sys, core, rec->address, REQUEST_WRITE, rec->len);
+		break;
+	case 'L':
+		coherentAccess(sys, core, rec->address, REQUEST_READ, rec->len);
+		break;
+	case 'S':
+		coherentAccess(sys, core, rec->address, REQUEST_WRITE, rec->len);
+		break;
+	}
+}
+
+coherentSystem* newCoherentSystem(cacheInfo info, replacementPolicy policy, int numCores,
+		coherenceProtocol protocol, const cacheInfo* llc) {
+	if(numCores < 1 || numCores > MAX_CORES) {
+		printf("Coherent simulations need 1 to %d traces.\n", MAX_CORES);
+		return NULL;
+	}
+
+	coherentSystem* sys = (coherentSystem*) calloc(1, sizeof(coherentSystem));
+	sys->protocol = protocol;
+	for(int i = 0; i < numCores; i++) {
+		sys->cores[i].info = info;
+		sys->cores[i].cache = newCache(info, policy);
+		if(sys->cores[i].cache == NULL) {
+			cleanCoherentSystem(sys); // frees the cores built so far
+			return NULL;
+		}
+		sys->numCores++;
+	}
+	if(llc != NULL) {
+		sys->llcInfo = *llc;
+		sys->llc = newCache(sys->llcInfo, policy);
+		if(sys->llc == NULL) {
+			cleanCoherentSystem(sys);
+			return NULL;
+		}
+	}
+	sys->lineCapacity = 1024;
+	sys->lines = (lineStats*) calloc(sys->lineCapacity, sizeof(lineStats));
+	return sys;
+}
+
+/*
+ * Most coherence misses first, then most invalidations, then by address
+ */
+static int compareLines(const void* a, const void* b) {
+	const lineStats* x = *(const lineStats* const*) a;
+	const lineStats* y = *(const lineStats* const*) b;
+	if(x->coherenceMisses != y->coherenceMisses) {
+		return y->coherenceMisses > x->coherenceMisses ? 1 : -1;
+	}
+	if(x->invalidations != y->invalidations) {
+		return y->invalidations > x->invalidations ? 1 : -1;
+	}
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+void printCoherentSummary(coherentSystem* sys, int verbose) {
+	char name[16];
+
+	for(int i = 0; i < sys->numCores; i++) {
+		coreState* core = &sys->cores[i];
+		snprintf(name, sizeof(name), "core%d", i);
+		printLevelSummary(name, core->info.numHits, core->info.numMisses, core->info.numEvicts);
+		printTrafficSummary(name, core->info.numDirtyEvicts, core->info.bytesRead, core->info.bytesWritten);
+		printf("%s coherence-misses:%llu false-sharing:%llu invalidations:%llu\n",
+				name, core->coherenceMisses, core->falseSharing, core->invalidations);
+	}
+	if(sys->llc != NULL) {
+		printLevelSummary("LLC", sys->llcInfo.numHits, sys->llcInfo.numMisses, sys->llcInfo.numEvicts);
+		printTrafficSummary("LLC", sys->llcInfo.numDirtyEvicts, sys->llcInfo.bytesRead, sys->llcInfo.bytesWritten);
+	}
+	printf("%s bus-reads:%llu bus-upgrades:%llu transfers:%llu\n",
+			sys->protocol == PROTOCOL_MESI ? "MESI" : "MOESI", sys->busReads, sys->busUpgrades, sys->transfers);
+
+	lineStats** sorted = (lineStats**) malloc((sys->numLines + 1) * sizeof(lineStats*));
+	size_t count = 0;
+	for(size_t i = 0; i < sys->lineCapacity; i++) {
+		if(sys->lines[i].key != 0) {
+			sorted[count++] = &sys->lines[i];
+		}
+	}
+	qsort(sorted, count, sizeof(lineStats*), compareLines);
+	size_t shown = verbose || count < COHERENCE_TOP_LINES ? count : COHERENCE_TOP_LINES;
+	for(size_t i = 0; i < shown; i++) {
+		printf("line %llx invalidations:%llu coherence-misses:%llu false-sharing:%llu\n",
+				(sorted[i]->key - 1) << sys->cores[0].info.b, sorted[i]->invalidations,
+				sorted[i]->coherenceMisses, sorted[i]->falseSharing);
+	}
+	if(shown < count) {
+		printf("(%zu more lines, -v lists them all)\n", count - shown);
+	}
+	free(sorted);
+}
+
+void cleanCoherentSystem(coherentSystem* sys) {
+	for(int i = 0; i < sys->numCores; i++) {
+		cleanCache(sys->cores[i].cache, sys->cores[i].info);
+	}
+	if(sys->llc != NULL) {
+		cleanCache(sys->llc, sys->llcInfo);
+	}
+	for(size_t i = 0; i < sys->lineCapacity; i++) {
+		free(sys->lines[i].written);
+	}
+	free(sys->lines);
+	free(sys);
+}
@@ -0,0 +1,78 @@
+/*
+ * coherence.h - Multi-core coherent cache simulation for csim
+ *
+ * Every core gets a private write-back cache of the same geometry, kept
+ * coherent by snooping the other cores on each miss and on each store to a
+ * shared line. Under MESI a dirty line another core reads is flushed to the
+ * shared level, while MOESI keeps it dirty in its owner (O) and supplies it
+ * cache to cache. An optional shared LLC sits below the private caches.
+ *
+ * A miss on a block this core lost to another core's store is a coherence
+ * miss. It is false sharing when none of the bytes the other cores wrote
+ * since then overlap the bytes this access touches.
+ */
+#ifndef CACHELAB_COHERENCE_H
+#define CACHELAB_COHERENCE_H
+
+#include "cache.h"
+#include "trace.h"
+
+#define MAX_CORES 64
+#define COHERENCE_TOP_LINES 20 /* lines listed in the summary unless it's verbose */
+
+typedef enum protocol {
+	PROTOCOL_MESI, // modified, exclusive, shared, invalid
+	PROTOCOL_MOESI // plus owned: dirty but shared
+} coherenceProtocol;
+
+typedef struct core {
+	Cache* cache; // this core's private cache
+	cacheInfo info; // its geometry and counters
+	unsigned long long coherenceMisses; // misses on blocks another core's store took away
+	unsigned long long falseSharing; // coherence misses on bytes nobody else wrote
+	unsigned long long invalidations; // lines other cores' stores took away
+} coreState;
+
+typedef struct lineStats {
+	unsigned long long key; // block number + 1, or 0 for an empty slot
+	unsigned long long invalidations; // copies of the block other cores' stores took away
+	unsigned long long coherenceMisses; // misses those invalidations caused
+	unsigned long long falseSharing; // the ones that didn't touch anything written since
+	unsigned long long invalidated; // cores that lost the block and haven't missed on it yet
+	unsigned long long* written; // per core: bytes others wrote since it lost the block (one bit per B/64 bytes)
+} lineStats;
+
+typedef struct coherent {
+	coreState cores[MAX_CORES];
+	int numCores;
+	coherenceProtocol protocol;
+	Cache* llc; // the shared last level, or NULL
+	cacheInfo llcInfo;
+	unsigned long long busReads; // misses snooped for a readable copy
+	unsigned long long busUpgrades; // stores to shared lines and store misses, snooped for ownership
+	unsigned long long transfers; // misses served cache to cache by a dirty owner
+	lineStats* lines; // open-addressed table of the blocks that were ever invalidated
+	size_t lineCapacity; // slots in lines (a power of 2)
+	size_t numLines; // slots in use
+} coherentSystem;
+
+/* The protocol called name ("mesi" or "moesi"), or -1 if there isn't one */
+int parseProtocol(const char* name);
+
+/*
+ * newCoherentSystem - numCores private caches of the given geometry and
+ *     policy, plus a shared LLC when llc isn't NULL. Returns NULL on error.
+ */
+coherentSystem* newCoherentSystem(cacheInfo info, replacementPolicy policy, int numCores,
+		coherenceProtocol protocol, const cacheInfo* llc);
+
+/* Run one trace record on a core */
+void coherentRecord(coherentSystem* sys, int core, const traceRecord* rec);
+
+/* Print every core's counters and the most contended lines (all of them when verbose) */
+void printCoherentSummary(coherentSystem* sys, int verbose);
+
+/* Free the caches and the line table */
+void cleanCoherentSystem(coherentSystem* sys);
+
+#endif /* CACHELAB_COHERENCE_H */
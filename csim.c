@@ -3,206 +3,1099 @@
  * Aaron Krueger (adkrueger)
  * Theo Campbell (tjcampbell)
  */
+#define _GNU_SOURCE
 #include "cachelab.h"
+#include "trace.h"
+#include "cache.h"
+#include "hierarchy.h"
+#include "coherence.h"
+#include "classify.h"
+#include "reuse.h"
+#include "prefetch.h"
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
 
+#define STREAM_CHUNK (1 << 20) // bytes read at a time when the trace can't be mapped
+#define RECORD_BATCH 1024 // records parsed before they're handed to the simulator
+#define QUEUE_SIZE (1 << 16) // accesses each worker's queue holds (a power of 2)
+#define SHARD_BATCH 256 // accesses the reader stages per worker before publishing them
+#define MAX_THREADS 256
+#define MAX_CONFIGS 16 // extra caches -C can simulate alongside the main one
+#define PROGRESS_STRIDE (1 << 20) // records between looks at the clock under -I
+#define CHECKPOINT_MAGIC 0x54504b434d495343ULL // "CSIMCKPT"
+#define CONFIDENCE_Z 1.96 // normal quantile for the 95% confidence intervals -Z reports
+#define NO_BLOCK (~0ULL) // a block number no address has
 
-typedef struct info {
-	int numEvicts; // the number of cache evictions
-	int numHits; // the number of cache hits
-	int numMisses; // the number of cache misses
-	int E; // the lines in the set
-	int S; // the number of sets
+/*
+ * Block-run folding: an access to the block the access just before it used
+ * is, once the run is long enough for the policy (see repeatHitsFold), a hit
+ * that changes nothing in the cache. Those are counted here instead of going
+ * through the tag search. Stores are only folded once the line is known to
+ * be dirty, or under write-through, where they're just forwarded bytes.
+ */
+typedef struct blockRun {
+	unsigned long long block; // the block the last access went to, or NO_BLOCK
+	int length; // accesses to it in a row since it was known to be in the cache
+	int dirty; // whether one of them dirtied it
+	int need; // the length a run needs before it folds (0 for never)
+	unsigned long long folded; // accesses counted here instead of in the cache
+} blockRun;
+
+
+typedef struct sim {
+	Cache* cache; // the cache being simulated
+	cacheInfo info; // its geometry and counters
+	int verbose; // print each access as it happens
+	missClassifier* classifier; // sorts the misses into the three Cs for -c, or NULL
+	prefetcher* prefetch; // the prefetcher from -F, or NULL
+	int regions; // whether marker accesses start a new region for the classifier
+	unsigned long long regionStart; // the marker that does
+	blockRun run; // folds repeated accesses when nothing is watching them one by one
+} simState;
+
+typedef struct sweep {
+	int minE; // the smallest associativity reported
+	int maxE; // the largest associativity reported (and the depth of each stack)
 	int s; // 2^s sets
-	int B; // the bytes in the cache "payload"
-	int b; // 2^e bytes per block
-} cacheInfo;
+	int b; // 2^b bytes per block
+	unsigned long long* stacks; // maxE tags per set, most recently used first
+	int* depths; // how many tags each set's stack holds
+	unsigned long long* hitDepth; // hitDepth[d] = accesses found at stack depth d
+	unsigned long long* coldDepth; // coldDepth[n] = accesses not found in a stack holding n tags
+	unsigned long long numAccesses; // every access seen
+} stackSweep;
+
+typedef struct access {
+	unsigned long long address;
+	unsigned int size; // bytes stored, for write-through traffic
+	int request; // REQUEST_READ or REQUEST_WRITE
+} shardAccess;
 
-typedef struct line {
-	int valid; // the valid bit
-	unsigned int tag; // the tag of the line to know if it's valid
-	int LRU; // least recently used (replacement policy)
-} cacheLine;
+/*
+ * A lock-free single producer, single consumer ring of accesses. The reader
+ * only writes tail and the worker only writes head, each on its own cache line.
+ */
+typedef struct queue {
+	shardAccess* ring; // QUEUE_SIZE accesses
+	unsigned long long head __attribute__((aligned(64))); // next slot the worker reads
+	unsigned long long tail __attribute__((aligned(64))); // next slot the reader fills
+	int done __attribute__((aligned(64))); // set once the reader has published everything
+} accessQueue;
+
+typedef struct shard {
+	pthread_t thread; // the worker
+	accessQueue queue; // accesses for the sets this worker owns
+	Cache* cache; // shared, but this worker only ever touches its own sets
+	cacheInfo info; // this worker's counters
+	shardAccess staged[SHARD_BATCH]; // reader side: accesses not yet published
+	unsigned int numStaged;
+} simShard;
 
-typedef struct set {
-	cacheLine* lines; // sets are made up of lines...
-} cacheSet;
+typedef struct traceLog {
+	traceRecord* recs; // every record of one trace
+	size_t count;
+	size_t capacity;
+} traceLog;
 
-typedef struct cache {
-	cacheSet* sets; // and caches are made up of sets
-} Cache;
+typedef struct parallel {
+	simShard* shards; // one per worker
+	int numShards;
+	cacheInfo info; // geometry for routing accesses to shards
+	blockRun run; // the reader folds before routing
+	cacheInfo folded; // the hits (and write-through bytes) of the accesses it folded, counted from 0
+} parallelSim;
+
+/*
+ * Trace readers hand parsed records to a sink in batches
+ */
+typedef void (*recordSink)(void* state, const traceRecord* recs, unsigned int count);
+
+int replayStopped = 0; // set by a sink that wants no more records, so the reader can stop early
+
+typedef struct filter {
+	int active; // whether any of the options below are set
+	int windowed; // only pass records from a start marker through the next end marker
+	unsigned long long markerStart; // the address that opens a window
+	unsigned long long markerEnd; // the address that closes it
+	unsigned long long limit; // drop accesses at or above this address (0 for no limit)
+	int inWindow; // between a start and an end marker right now (carried across a checkpoint)
+	double progress; // seconds between progress reports on stderr (0 for none)
+	unsigned long long skip; // records at the start of the trace to pass over, e.g. the ones a checkpoint covers
+	unsigned long long maxRecords; // stop after this many records past those (0 for no limit)
+	unsigned long long position; // set by replayTrace: records it got through, skipped ones included
+	recordSink sink; // where the records that pass go
+	void* state;
+	traceRecord batch[RECORD_BATCH]; // records that passed, not yet handed on
+} traceFilter;
+
+typedef struct progressMeter {
+	double interval; // seconds between reports
+	double start; // when the replay began
+	double last; // when the last report was printed
+	unsigned long long records; // records read so far
+	unsigned long long lastRecords; // records read by the last report
+	unsigned long long nextCheck; // when to look at the clock again
+	recordSink sink; // where the records go
+	void* state;
+} progressMeter;
+
+typedef struct recordRange {
+	unsigned long long skip; // records still to pass over
+	unsigned long long left; // records still to hand on, if limited
+	int limited; // whether -n set a limit
+	unsigned long long position; // records passed over or handed on so far
+	recordSink sink; // where the records in range go
+	void* state;
+} recordRange;
+
+typedef struct sampler {
+	unsigned long long period; // records in each sampling unit
+	unsigned long long window; // records measured at the end of each unit
+	unsigned long long warmup; // records simulated unmeasured just before each window
+	unsigned long long offset; // records into the current unit
+	simState* sim; // the cache being sampled
+	cacheInfo opened; // its counters when the current window opened
+	cacheInfo measured; // counters added up over every complete window
+	unsigned long long windows; // complete windows with at least one access
+	double ratioSum; // their miss ratios added up
+	double ratioSquares; // and their squares, for the variance
+	unsigned long long accesses; // data accesses in the whole trace, simulated or not
+	unsigned long long records; // records in the whole trace
+	unsigned long long simulated; // records run through the cache
+} sampler;
+
+typedef struct fanOut {
+	simState* sims; // every cache fed by the one trace
+	int numSims;
+} fanOut;
 
 /**
- * A method to check for the index of the line we want to evict
+ * Start a run for a cache. CSIM_FOLD=off turns folding off, to check it against.
  */
-int findEvictIndex(cacheSet currSet, cacheInfo info, int* maxLRU) {
-	int evictIndex = 0;
-	int minLRU = currSet.lines[0].LRU;
-	*maxLRU = currSet.lines[0].LRU;
+void initBlockRun(blockRun* run, const Cache* cache) {
+	const char* mode = getenv("CSIM_FOLD");
+	run->block = NO_BLOCK;
+	run->length = 0;
+	run->dirty = 0;
+	run->need = mode != NULL && strcmp(mode, "off") == 0 ? 0 : repeatHitsFold(cache);
+	run->folded = 0;
+}
 
-	for(int i = 0; i < info.E; i++) {
-		if(currSet.lines[i].LRU < minLRU) { // if we've found a line that's less than the minimum
-			minLRU = currSet.lines[i].LRU;
-			evictIndex = i; // set the evictIndex so we know which line to evict
+/**
+ * Count a demand access in *info and return 1 if the run lets it skip the
+ * cache. Otherwise note it in the run and return 0: the caller makes it.
+ */
+static inline int foldAccess(blockRun* run, const Cache* cache, cacheInfo* info, unsigned long long address, int request, unsigned int size) {
+	unsigned long long block = address >> info->b;
+	int write = request == REQUEST_WRITE;
+	if(block != run->block) {
+		run->block = block;
+		run->length = 0;
+		run->dirty = 0;
+	}
+	else if(run->need > 0 && run->length >= run->need && (!write || !cache->writeBack || run->dirty)) {
+		info->numHits++;
+		if(write && !cache->writeBack) { // written through
+			info->bytesWritten += size;
 		}
-		if(*maxLRU < currSet.lines[i].LRU) { // make sure our maximum LRU value is properly updated
-			*maxLRU = currSet.lines[i].LRU;
+		run->folded++;
+		return 1;
+	}
+	if(run->length > 0 || !write || cache->writeAllocate) { // the block is in the cache once this is done
+		run->length++;
+		run->dirty |= write && cache->writeBack;
+	}
+	return 0;
+}
+
+/**
+ * processRecord with block-run folding
+ */
+static inline cacheInfo foldRecord(Cache* cache, cacheInfo info, blockRun* run, const traceRecord* rec) {
+	char c = rec->op;
+	if((c == 'L' || c == 'M') && !foldAccess(run, cache, &info, rec->address, REQUEST_READ, rec->len)) {
+		info = processCache(cache, info, rec->address, REQUEST_READ, rec->len, 0);
+	}
+	if((c == 'S' || c == 'M') && !foldAccess(run, cache, &info, rec->address, REQUEST_WRITE, rec->len)) {
+		info = processCache(cache, info, rec->address, REQUEST_WRITE, rec->len, 0);
+	}
+	return info;
+}
+
+/**
+ * Run a single trace record through the cache
+ */
+cacheInfo processRecord(Cache* cache, cacheInfo info, const traceRecord* rec, int verbose) {
+	char c = rec->op;
+	if(c != 'I') {
+		if(verbose) { printf("%c %llx,%u ", c, rec->address, rec->len); }
+		if(c == 'M') { // a modify loads the block and then stores to it
+			info = processCache(cache, info, rec->address, REQUEST_READ, rec->len, verbose);
+			info = processCache(cache, info, rec->address, REQUEST_WRITE, rec->len, verbose);
+		}
+		else if(c == 'L' || c == 'S') {  // otherwise, all we have to do is process cache once
+			info = processCache(cache, info, rec->address, c == 'S' ? REQUEST_WRITE : REQUEST_READ, rec->len, verbose);
 		}
+		if(verbose) { printf("\n"); }
 	}
+	return info;
+}
 
-	return evictIndex;
+/**
+ * Run one request through the cache, then the classifier and the prefetcher if there are any
+ */
+void instrumentRequest(simState* sim, unsigned long long address, int request, unsigned int len) {
+	unsigned long long evicted;
+	int result = accessCache(sim->cache, &sim->info, address, request, len, sim->verbose, &evicted);
+	if(sim->classifier != NULL) {
+		int missClass = classifyAccess(sim->classifier, address, request, result);
+		if(sim->verbose && missClass != MISS_NONE) { printf("%s ", missClassName(missClass)); }
+	}
+	if(sim->prefetch != NULL) {
+		prefetchAccess(sim->prefetch, sim->cache, &sim->info, address, request, result);
+	}
 }
 
 /**
- * A simple method that checks to see if any line is invalid (AKA empty) and returns that index
+ * processRecord for -c and -F
  */
-int findEmptyIndex(cacheSet currSet, cacheInfo info) {
-	for(int i = 0; i < info.E; i++) {
-		if(!currSet.lines[i].valid) {
-			return i;
+void instrumentRecord(simState* sim, const traceRecord* rec) {
+	char c = rec->op;
+	if(c != 'I') {
+		if(sim->regions && rec->address == sim->regionStart) {
+			startRegion(sim->classifier);
+		}
+		if(sim->verbose) { printf("%c %llx,%u ", c, rec->address, rec->len); }
+		if(c == 'M') {
+			instrumentRequest(sim, rec->address, REQUEST_READ, rec->len);
+			instrumentRequest(sim, rec->address, REQUEST_WRITE, rec->len);
+		}
+		else if(c == 'L' || c == 'S') {
+			instrumentRequest(sim, rec->address, c == 'S' ? REQUEST_WRITE : REQUEST_READ, rec->len);
 		}
+		if(sim->verbose) { printf("\n"); }
 	}
-	return -1;
 }
 
-/*
- * Process the cache and adjust the number of hits, misses evictions
+/**
+ * The recordSink for a normal run: replay every record through one cache
+ */
+void simulateRecords(void* state, const traceRecord* recs, unsigned int count) {
+	simState* sim = (simState*) state;
+	if(sim->classifier != NULL || sim->prefetch != NULL) { // kept out of the plain loop so it stays as fast as it was
+		for(unsigned int i = 0; i < count; i++) {
+			instrumentRecord(sim, &recs[i]);
+		}
+		return;
+	}
+	if(sim->run.need > 0 && !sim->verbose) { // verbose output has to show every access
+		for(unsigned int i = 0; i < count; i++) {
+			sim->info = foldRecord(sim->cache, sim->info, &sim->run, &recs[i]);
+		}
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++) {
+		sim->info = processRecord(sim->cache, sim->info, &recs[i], sim->verbose);
+	}
+}
+
+/**
+ * The recordSink for -Z, in front of simulateRecords. Each unit of period
+ * records is passed over until the warmup before its window, which is
+ * simulated to bring the cache back up to date, and then the window is
+ * simulated and measured. With warmup covering the whole gap every record
+ * goes through the cache and only the measuring is sampled.
  */
-cacheInfo processCache(Cache* cache, cacheInfo info, unsigned long long address, int verbose) {
-	unsigned long long tag = address >> (info.s + info.b); // find the tag (which is shifted over by s and b to be comparable to our tag)
-	unsigned long long setNum = (address << (64 - info.s - info.b)) >> (64 - info.s); // find the appropriate number of the set (found this equation from lab)
-	cacheSet currSet = cache->sets[setNum]; // the current set we're looking at
-	int evictIndex, emptyIndex;
+void sampleRecords(void* state, const traceRecord* recs, unsigned int count) {
+	sampler* samp = (sampler*) state;
+	unsigned long long warmStart = samp->period - samp->window - samp->warmup;
+	unsigned long long windowStart = samp->period - samp->window;
 
-	for(int i = 0; i < info.E; i++) {
-		if(currSet.lines[i].valid && currSet.lines[i].tag == tag) { // if the line we're examining is valid and the tag matches, then hit
-			info.numHits++; // update the number of hits
-			if(verbose) { printf("hit "); }
-			currSet.lines[i].LRU++; // update the LRU value of this line
-			return info;
+	samp->records += count;
+	for(unsigned int i = 0; i < count; i++) {
+		samp->accesses += recs[i].op == 'M' ? 2 : recs[i].op != 'I';
+	}
+	while(count > 0) { // one phase of the unit at a time
+		unsigned long long end = samp->offset < warmStart ? warmStart : samp->offset < windowStart ? windowStart : samp->period;
+		unsigned int run = end - samp->offset < count ? (unsigned int) (end - samp->offset) : count;
+		if(samp->offset == windowStart) {
+			samp->opened = samp->sim->info;
+		}
+		if(samp->offset >= warmStart) {
+			simulateRecords(samp->sim, recs, run);
+			samp->simulated += run;
+		}
+		samp->offset += run;
+		recs += run;
+		count -= run;
+
+		if(samp->offset == samp->period) { // the window is complete
+			const cacheInfo* at = &samp->sim->info;
+			unsigned long long hits = at->numHits - samp->opened.numHits;
+			unsigned long long misses = at->numMisses - samp->opened.numMisses;
+			if(hits + misses > 0) {
+				double ratio = (double) misses / (hits + misses);
+				samp->windows++;
+				samp->ratioSum += ratio;
+				samp->ratioSquares += ratio * ratio;
+			}
+			samp->measured.numHits += hits;
+			samp->measured.numMisses += misses;
+			samp->measured.numEvicts += at->numEvicts - samp->opened.numEvicts;
+			samp->measured.numDirtyEvicts += at->numDirtyEvicts - samp->opened.numDirtyEvicts;
+			samp->measured.bytesRead += at->bytesRead - samp->opened.bytesRead;
+			samp->measured.bytesWritten += at->bytesWritten - samp->opened.bytesWritten;
+			samp->offset = 0;
 		}
 	}
+}
+
+/**
+ * Print what -Z measured: the mean miss ratio of the windows with its 95%
+ * confidence interval, and the misses that implies for the whole trace
+ */
+void printSampleSummary(const sampler* samp) {
+	double n = (double) samp->windows;
+	double mean = n > 0 ? samp->ratioSum / n : 0;
+	printf("sampled: %llu windows of %llu records every %llu, %.1f%% of %llu records simulated\n",
+			samp->windows, samp->window, samp->period,
+			samp->records > 0 ? 100.0 * samp->simulated / samp->records : 0, samp->records);
+	if(samp->windows < 2) {
+		printf("miss-ratio: %.6f (too few windows for a confidence interval)\n", mean);
+		return;
+	}
+	double variance = (samp->ratioSquares - n * mean * mean) / (n - 1);
+	double half = CONFIDENCE_Z * sqrt(variance > 0 ? variance / n : 0);
+	printf("miss-ratio: %.6f +/- %.6f (95%% confidence, %.2f%% relative)\n", mean, half, mean > 0 ? 100 * half / mean : 0);
+	printf("estimated-misses: %.0f +/- %.0f of %llu accesses\n", mean * samp->accesses, half * samp->accesses, samp->accesses);
+}
 
-	info.numMisses++; // if we've made it to this point, we know there wasn't a hit and we missed
-	if(verbose) { printf("miss "); }
+/**
+ * Write a checkpoint: where the replay got to and the marker window state,
+ * then the cache's snapshot (see saveCache)
+ */
+int saveCheckpoint(const char* file, const Cache* cache, cacheInfo info, const traceFilter* filter) {
+	FILE* fp = fopen(file, "wb");
+	if(fp == NULL) {
+		perror(file);
+		return -1;
+	}
+	unsigned long long header[3] = { CHECKPOINT_MAGIC, filter->position, (unsigned long long) filter->inWindow };
+	int status = fwrite(header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+	status |= saveCache(cache, info, fp);
+	if(fclose(fp) != 0 || status != 0) {
+		printf("Couldn't write the checkpoint to %s.\n", file);
+		return -1;
+	}
+	return 0;
+}
 
-	// check to see if there are any empty indices
-	int* maxLRU = (int*) malloc(sizeof(int*)); // need to create a pointer so we can update our max LRU value in the same function that we find the evictIndex in
-	evictIndex = findEvictIndex(currSet, info, maxLRU);
-	int actualLRU = *maxLRU + 1; // maxLRU will now hold the highest LRU in the table
-	free(maxLRU); // don't need maxLRU anymore so we can free it
-	emptyIndex = findEmptyIndex(currSet, info);
+/**
+ * Read a checkpoint back into a cache, *info and the filter's place in the trace
+ */
+Cache* loadCheckpoint(const char* file, cacheInfo* info, traceFilter* filter) {
+	FILE* fp = fopen(file, "rb");
+	if(fp == NULL) {
+		perror(file);
+		return NULL;
+	}
+	unsigned long long header[3];
+	Cache* cache = NULL;
+	if(fread(header, sizeof(header), 1, fp) != 1 || header[0] != CHECKPOINT_MAGIC) {
+		printf("%s isn't a checkpoint.\n", file);
+	}
+	else if((cache = loadCache(fp, info)) != NULL) {
+		filter->skip = header[1];
+		filter->inWindow = (int) header[2];
+	}
+	fclose(fp);
+	return cache;
+}
 
-	if(emptyIndex == -1) { // if there is no empty space (cache is full), we must evict
-		info.numEvicts++; // update the number of evictions
-		if(verbose) { printf("eviction "); }
+/**
+ * Worker loop: replay everything the reader routes to this shard until the reader is done
+ */
+void* runShard(void* arg) {
+	simShard* shard = (simShard*) arg;
+	accessQueue* q = &shard->queue;
+	unsigned long long head = q->head;
 
-		currSet.lines[evictIndex].tag = tag; // set the tag
-		currSet.lines[evictIndex].LRU = actualLRU; // need to set to the maxLRU + 1 because this is now the most recently used line
+	for(;;) {
+		unsigned long long tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if(head == tail) {
+			if(__atomic_load_n(&q->done, __ATOMIC_ACQUIRE) && head == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+				break; // nothing left and nothing more coming
+			}
+			sched_yield();
+			continue;
+		}
+		for(; head != tail; head++) { // drain everything published so far before touching head again
+			const shardAccess* a = &q->ring[head & (QUEUE_SIZE - 1)];
+			shard->info = processCache(shard->cache, shard->info, a->address, a->request, a->size, 0);
+		}
+		__atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
 	}
-	else { // if cache is not full (we found an empty line)
-		currSet.lines[emptyIndex].valid = 1; // set validity to 1 (as we now know for sure that this line is valid)
-		currSet.lines[emptyIndex].tag = tag; // set the tag
-		currSet.lines[emptyIndex].LRU = actualLRU; // need to set to the maxLRU because this is now the most recently used line
+	return NULL;
+}
+
+/**
+ * Reader side: copy a shard's staged accesses into its queue, waiting for room if the worker is behind
+ */
+void publishShard(simShard* shard) {
+	accessQueue* q = &shard->queue;
+	unsigned long long tail = q->tail;
+
+	while(tail + shard->numStaged - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) > QUEUE_SIZE) {
+		sched_yield();
+	}
+	for(unsigned int i = 0; i < shard->numStaged; i++) {
+		q->ring[(tail + i) & (QUEUE_SIZE - 1)] = shard->staged[i];
 	}
+	__atomic_store_n(&q->tail, tail + shard->numStaged, __ATOMIC_RELEASE);
+	shard->numStaged = 0;
+}
 
-	return info;
+/**
+ * Wait until every worker has replayed everything routed to it so far
+ */
+static void drainShards(parallelSim* par) {
+	for(int i = 0; i < par->numShards; i++) {
+		simShard* shard = &par->shards[i];
+		publishShard(shard);
+		while(__atomic_load_n(&shard->queue.head, __ATOMIC_ACQUIRE) != shard->queue.tail) {
+			sched_yield();
+		}
+	}
+}
+
+/**
+ * Stage one access for the worker that owns its set. The workers share the
+ * cache, so a tag that doesn't pack is fitted here while they're all idle.
+ */
+static void routeAccess(parallelSim* par, unsigned long long address, int request, unsigned int size) {
+	Cache* cache = par->shards[0].cache;
+	if(par->run.need > 0 && foldAccess(&par->run, cache, &par->folded, address, request, size)) {
+		return; // only the reader reads the run, and the cache fields it looks at never change
+	}
+	if(!tagFits(cache, par->info, address)) {
+		drainShards(par);
+		fitTag(cache, par->info, address);
+	}
+	unsigned long long setNum = (address >> par->info.b) & (par->info.S - 1);
+	simShard* shard = &par->shards[(setNum * par->numShards) >> par->info.s]; // contiguous slices of sets
+	shardAccess* a = &shard->staged[shard->numStaged++];
+	a->address = address;
+	a->request = request;
+	a->size = size;
+	if(shard->numStaged == SHARD_BATCH) {
+		publishShard(shard);
+	}
 }
 
 /**
- * Process the file's input and run processCache according to the trace file
+ * The recordSink for -j: the reader splits every record into per-set accesses for the workers
  */
-cacheInfo processFile(Cache* cache, cacheInfo info, int verbose, char* file) {
-	char s[20];
-	char c; // get the first character we need (either L, M, or S)
+void shardRecords(void* state, const traceRecord* recs, unsigned int count) {
+	parallelSim* par = (parallelSim*) state;
+	for(unsigned int i = 0; i < count; i++) {
+		if(recs[i].op == 'M') { // a modify is a load and a store to the same set
+			routeAccess(par, recs[i].address, REQUEST_READ, recs[i].len);
+			routeAccess(par, recs[i].address, REQUEST_WRITE, recs[i].len);
+		}
+		else if(recs[i].op == 'L' || recs[i].op == 'S') {
+			routeAccess(par, recs[i].address, recs[i].op == 'S' ? REQUEST_WRITE : REQUEST_READ, recs[i].len);
+		}
+	}
+}
 
-	FILE* fp = fopen(file, "r"); // open the file to read, fp points to the beginning
-	if(fp == NULL) { // if there's no file then don't continue
-		puts("File not found.");
-		return info;
+/**
+ * Start numShards workers, each owning a contiguous slice of the cache's sets
+ */
+parallelSim* newParallelSim(Cache* cache, cacheInfo info, int numShards) {
+	parallelSim* par = (parallelSim*) malloc(sizeof(parallelSim));
+	par->info = info;
+	initBlockRun(&par->run, cache);
+	par->folded = info; // the geometry, for foldAccess
+	par->folded.numHits = par->folded.numMisses = par->folded.numEvicts = 0;
+	par->folded.numDirtyEvicts = par->folded.bytesRead = par->folded.bytesWritten = 0;
+	par->numShards = numShards;
+	par->shards = (simShard*) calloc(numShards, sizeof(simShard));
+
+	for(int i = 0; i < numShards; i++) {
+		simShard* shard = &par->shards[i];
+		shard->queue.ring = (shardAccess*) malloc(QUEUE_SIZE * sizeof(shardAccess));
+		shard->cache = cache;
+		shard->info = info;
+		shard->info.numHits = shard->info.numMisses = shard->info.numEvicts = 0; // info may carry a checkpoint's counters
+		shard->info.numDirtyEvicts = shard->info.bytesRead = shard->info.bytesWritten = 0;
+		pthread_create(&shard->thread, NULL, runShard, shard);
+	}
+	return par;
+}
+
+/**
+ * Flush what's left, wait for the workers and add up their counters and the
+ * reader's folded hits, whose number goes in *folded
+ */
+cacheInfo finishParallelSim(parallelSim* par, cacheInfo info, unsigned long long* folded) {
+	for(int i = 0; i < par->numShards; i++) {
+		publishShard(&par->shards[i]);
+		__atomic_store_n(&par->shards[i].queue.done, 1, __ATOMIC_RELEASE);
+	}
+	for(int i = 0; i < par->numShards; i++) {
+		simShard* shard = &par->shards[i];
+		pthread_join(shard->thread, NULL);
+		info.numHits += shard->info.numHits;
+		info.numMisses += shard->info.numMisses;
+		info.numEvicts += shard->info.numEvicts;
+		info.numDirtyEvicts += shard->info.numDirtyEvicts;
+		info.bytesRead += shard->info.bytesRead;
+		info.bytesWritten += shard->info.bytesWritten;
+		free(shard->queue.ring);
+	}
+	info.numHits += par->folded.numHits;
+	info.bytesWritten += par->folded.bytesWritten;
+	*folded = par->run.folded;
+	free(par->shards);
+	free(par);
+	return info;
+}
+
+/**
+ * The recordSink for -C: every cache sees every record
+ */
+void fanOutRecords(void* state, const traceRecord* recs, unsigned int count) {
+	fanOut* fan = (fanOut*) state;
+	for(int i = 0; i < fan->numSims; i++) {
+		simulateRecords(&fan->sims[i], recs, count);
 	}
+}
 
-	while(fgets(s, 20, fp) != NULL) {
-		unsigned long long address = 0; // the address in the trace file given by valgrind
-		unsigned int len = 0; // the length given by valgrind
-		sscanf(s, " %c %llx,%u", &c, &address, &len); // initialize  each variable to what we have in the trace file
-		if(c != 'I') {
-			if(verbose) { printf("%c %llx,%u ", c, address, len); }
-			if(c == 'M') { // if we have a miss, we need to process the info twice to move info back into the cache
-				info = processCache(cache, info, address, verbose);
-				info = processCache(cache, info, address, verbose);
+/**
+ * A recordSink in front of another one that drops records outside the
+ * marker windows and at or above the address limit. The markers themselves
+ * are inside the window, as in test-trans.
+ */
+void filterRecords(void* state, const traceRecord* recs, unsigned int count) {
+	traceFilter* filter = (traceFilter*) state;
+	unsigned int passed = 0;
+
+	for(unsigned int i = 0; i < count; i++) {
+		const traceRecord* rec = &recs[i];
+		int data = rec->op != 'I'; // only data accesses can be markers
+		if(filter->windowed && !filter->inWindow) {
+			if(!data || rec->address != filter->markerStart) {
+				continue;
 			}
-			else if(c == 'L' || c == 'S') {  // otherwise, all we have to do is process cache once
-				info = processCache(cache, info, address, verbose);
+			filter->inWindow = 1;
+		}
+		if(filter->limit == 0 || rec->address < filter->limit) {
+			filter->batch[passed++] = *rec;
+			if(passed == RECORD_BATCH) {
+				filter->sink(filter->state, filter->batch, passed);
+				passed = 0;
 			}
-			if(verbose) { printf("\n"); }
+		}
+		if(filter->windowed && data && rec->address == filter->markerEnd) {
+			filter->inWindow = 0;
 		}
 	}
-	fclose(fp);
+	if(passed > 0) {
+		filter->sink(filter->state, filter->batch, passed);
+	}
+}
+
+/**
+ * Set up a sweep over associativities minE..maxE with an empty LRU stack per set
+ */
+stackSweep* newSweep(cacheInfo info, int minE, int maxE) {
+	stackSweep* sweep = (stackSweep*) malloc(sizeof(stackSweep));
+	sweep->minE = minE;
+	sweep->maxE = maxE;
+	sweep->s = info.s;
+	sweep->b = info.b;
+	sweep->stacks = (unsigned long long*) malloc((size_t) info.S * maxE * sizeof(unsigned long long));
+	sweep->depths = (int*) calloc(info.S, sizeof(int));
+	sweep->hitDepth = (unsigned long long*) calloc(maxE, sizeof(unsigned long long));
+	sweep->coldDepth = (unsigned long long*) calloc(maxE + 1, sizeof(unsigned long long));
+	sweep->numAccesses = 0;
+	return sweep;
+}
+
+/**
+ * Push one access through its set's LRU stack. An access found at depth d hits in
+ * every cache with more than d lines; anything not in the top maxE entries misses in all of them.
+ */
+void sweepAccess(stackSweep* sweep, unsigned long long address) {
+	unsigned long long tag = address >> (sweep->s + sweep->b);
+	unsigned long long setNum = (address >> sweep->b) & ((1ULL << sweep->s) - 1);
+	unsigned long long* stack = sweep->stacks + setNum * sweep->maxE; // most recently used first
+	int depth = sweep->depths[setNum];
+	int d = 0;
+
+	sweep->numAccesses++;
+	while(d < depth && stack[d] != tag) { d++; }
+
+	if(d < depth) { // found it, so it's a hit for every E > d
+		sweep->hitDepth[d]++;
+	}
+	else { // not in the stack: a miss everywhere, and an eviction for every E the set already fills
+		sweep->coldDepth[depth]++;
+		if(depth < sweep->maxE) {
+			sweep->depths[setNum] = ++depth;
+		}
+		d = depth - 1; // the bottom entry falls off (or the new slot is used)
+	}
+
+	memmove(stack + 1, stack, d * sizeof(unsigned long long)); // move everything above it down one
+	stack[0] = tag;
+}
+
+/**
+ * The recordSink for a sweep: same dispatch as processRecord, minus the cache
+ */
+void sweepRecords(void* state, const traceRecord* recs, unsigned int count) {
+	stackSweep* sweep = (stackSweep*) state;
+	for(unsigned int i = 0; i < count; i++) {
+		if(recs[i].op == 'M') {
+			sweepAccess(sweep, recs[i].address);
+			sweepAccess(sweep, recs[i].address);
+		}
+		else if(recs[i].op == 'L' || recs[i].op == 'S') {
+			sweepAccess(sweep, recs[i].address);
+		}
+	}
+}
+
+/**
+ * The recordSink for -r: same dispatch again, into the reuse profile
+ */
+void reuseRecords(void* state, const traceRecord* recs, unsigned int count) {
+	reuseProfile* profile = (reuseProfile*) state;
+	for(unsigned int i = 0; i < count; i++) {
+		if(recs[i].op == 'M') {
+			reuseAccess(profile, recs[i].address);
+			reuseAccess(profile, recs[i].address);
+		}
+		else if(recs[i].op == 'L' || recs[i].op == 'S') {
+			reuseAccess(profile, recs[i].address);
+		}
+	}
+}
+
+/**
+ * Turn the stack depth histograms into the hits, misses and evictions for E lines per set
+ */
+cacheInfo sweepResult(stackSweep* sweep, cacheInfo info, int E) {
+	unsigned long long hits = 0, evicts = 0;
+	for(int d = 0; d < sweep->maxE; d++) {
+		if(d < E) {
+			hits += sweep->hitDepth[d];
+		}
+		else { // reused too far back to still be in an E-way set, so it pushed something out
+			evicts += sweep->hitDepth[d];
+		}
+	}
+	for(int n = E; n <= sweep->maxE; n++) { // cold misses in sets that were already full
+		evicts += sweep->coldDepth[n];
+	}
+
+	info.E = E;
+	info.numHits = hits;
+	info.numMisses = sweep->numAccesses - hits;
+	info.numEvicts = evicts;
 	return info;
 }
 
-/*
- * print out the program usage
+void cleanSweep(stackSweep* sweep) {
+	free(sweep->stacks);
+	free(sweep->depths);
+	free(sweep->hitDepth);
+	free(sweep->coldDepth);
+	free(sweep);
+}
+
+/**
+ * Parse every complete line in buf[0, size) into batches for the sink and return how many bytes were used.
+ * If final is 0, a trailing line without a newline is left for the next call.
  */
-void printUsage() {
-	puts("USAGE:");
-	puts("./csim [-hv] -s <s> -E <E> -b <b> -t <tracefile>");
-	puts("Where...");
-	puts("\t• -h: Optional help flag that prints usage info\n"
-			"\t• -v: Optional verbose flag that displays trace info\n"
-			"\t• -s <s>: Number of set index bits (the number of sets is 2^s)\n"
-			"\t• -E <E>: Associativity (number of lines per set)\n"
-			"\t• -b <b>: Number of block bits (the block size is 2^b)\n"
-			"\t• -t <tracefile>: Name of the valgrind trace to replay");
+size_t processBuffer(const char* buf, size_t size, int final, recordSink sink, void* state) {
+	const char* pos = buf;
+	const char* end = buf + size;
+	traceRecord batch[RECORD_BATCH];
+	unsigned int count = 0;
+
+	if(!final) { // only look at whole lines so we never parse half of one
+		while(end > buf && end[-1] != '\n') { end--; }
+	}
+
+	while(pos < end && !replayStopped) {
+		if(parseTraceLine(&pos, end, &batch[count]) && ++count == RECORD_BATCH) {
+			sink(state, batch, count);
+			count = 0;
+		}
+	}
+	if(count > 0) {
+		sink(state, batch, count);
+	}
+
+	return pos - buf;
 }
 
-/*
- * Allocate space for each of the lines and sets in the cache
+/**
+ * Read a trace we can't map (a pipe, FIFO or stdin) in large chunks, carrying any partial line over
  */
-Cache* newCache(cacheInfo info) {
-	Cache* cache = (Cache*) malloc(sizeof(Cache));
-	cache->sets = (cacheSet*) malloc(info.S * sizeof(cacheSet));
+void processStream(int fd, recordSink sink, void* state) {
+	size_t cap = STREAM_CHUNK;
+	size_t have = 0;
+	char* buf = (char*) malloc(cap);
+	ssize_t got;
 
-	//for each set, go through and initialize each line with values of 0 and allocate space for it
-	for(int i = 0; i < info.S; i++) {
-		cacheLine* lines = (cache->sets[i].lines);
-		lines = (cacheLine*) malloc(info.E * sizeof(cacheLine)); // allocate space for the line
+	while(!replayStopped && (got = read(fd, buf + have, cap - have)) != 0) {
+		if(got < 0) {
+			if(errno == EINTR) { continue; }
+			perror("read");
+			break;
+		}
+		have += got;
 
-		for(int j = 0; j < info.E; j++) {
-			lines[j].valid = 0;
-			lines[j].tag = 0;
-			lines[j].LRU = 0;
+		size_t used = processBuffer(buf, have, 0, sink, state);
+		memmove(buf, buf + used, have - used); // keep the partial line for the next read
+		have -= used;
+
+		if(have == cap) { // one line filled the whole buffer, so make room for the rest of it
+			cap *= 2;
+			buf = (char*) realloc(buf, cap);
 		}
-		cache->sets[i].lines = lines;
 	}
 
-	return cache;
+	if(have > 0 && !replayStopped) { // the last line may not end in a newline
+		processBuffer(buf, have, 1, sink, state);
+	}
+	free(buf);
+}
+
+/**
+ * Process the file's input and hand the records to the sink in batches.
+ * Regular files are mapped and parsed in place; anything else ("-" for stdin, pipes) is streamed.
+ */
+int processFile(char* file, recordSink sink, void* state) {
+	struct stat st;
+	int fd = (strcmp(file, "-") == 0) ? STDIN_FILENO : open(file, O_RDONLY);
+
+	if(fd < 0) { // if there's no file then don't continue
+		puts("File not found.");
+		return -1;
+	}
+
+	initTraceParser();
+
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL); // we only ever walk forward through the trace
+			processBuffer(map, st.st_size, 1, sink, state);
+			munmap(map, st.st_size);
+			close(fd);
+			return 0;
+		}
+	}
+
+	processStream(fd, sink, state); // couldn't map it, so fall back to reading it
+	if(fd != STDIN_FILENO) { close(fd); }
+	return 0;
+}
+
+/**
+ * Replay a binary trace (see trace.h) one decoded block at a time, starting
+ * at record first. The blocks before it aren't even decoded.
+ */
+int processBinaryFile(char* file, unsigned long long first, recordSink sink, void* state) {
+	binTrace trace;
+
+	if(openBinTrace(&trace, file) != 0) {
+		puts("Not a valid binary trace.");
+		return -1;
+	}
+
+	unsigned long long start;
+	unsigned long long block = findBinBlock(&trace, first, &start);
+	traceRecord* recs = (traceRecord*) malloc(trace.blockRecords * sizeof(traceRecord));
+	int status = 0;
+	for(; block < trace.numBlocks && !replayStopped; block++) {
+		unsigned int count;
+		if(readBinBlock(&trace, block, recs, &count) != 0) {
+			printf("The binary trace is corrupt in block %llu.\n", block);
+			status = -1;
+			break;
+		}
+		unsigned int from = first > start ? (unsigned int) (first - start) : 0; // only the first block starts partway
+		if(from < count) {
+			sink(state, recs + from, count - from);
+		}
+		start += count;
+	}
+	free(recs);
+	closeBinTrace(&trace);
+	return status;
 }
 
 /**
- * make sure to free all pointers in the Cache
+ * The recordSink for -P: keep every record so the cores' traces can be interleaved
  */
-void cleanCache(Cache* cache, cacheInfo info) {
-	for(int i = 0; i < info.S; i++) {
-		free(cache->sets[i].lines);
+void logRecords(void* state, const traceRecord* recs, unsigned int count) {
+	traceLog* log = (traceLog*) state;
+	if(log->count + count > log->capacity) {
+		log->capacity = 2 * (log->count + count);
+		log->recs = (traceRecord*) realloc(log->recs, log->capacity * sizeof(traceRecord));
 	}
-	free(cache->sets);
-	free(cache);
+	memcpy(log->recs + log->count, recs, count * sizeof(traceRecord));
+	log->count += count;
+}
+
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void reportProgress(const progressMeter* meter, double at, const char* when) {
+	double elapsed = at - meter->start;
+	double recent = at - meter->last;
+	fprintf(stderr, "progress%s: %llu records in %.1fs, %.2fM records/s (%.2fM/s since the last report)\n",
+			when, meter->records, elapsed, elapsed > 0 ? meter->records / elapsed / 1e6 : 0,
+			recent > 0 ? (meter->records - meter->lastRecords) / recent / 1e6 : 0);
+}
+
+/**
+ * A recordSink in front of another one that counts the records and reports
+ * the count and rate on stderr every interval. The clock is only read every
+ * PROGRESS_STRIDE records, so the report can come a little late.
+ */
+void progressRecords(void* state, const traceRecord* recs, unsigned int count) {
+	progressMeter* meter = (progressMeter*) state;
+	meter->sink(meter->state, recs, count);
+	meter->records += count;
+	if(meter->records < meter->nextCheck) {
+		return;
+	}
+	meter->nextCheck = meter->records + PROGRESS_STRIDE;
+	double at = now();
+	if(at - meter->last >= meter->interval) {
+		reportProgress(meter, at, "");
+		meter->last = at;
+		meter->lastRecords = meter->records;
+	}
+}
+
+/**
+ * A recordSink in front of another one that passes over the first records
+ * and stops the replay once the limit has been handed on
+ */
+void rangeRecords(void* state, const traceRecord* recs, unsigned int count) {
+	recordRange* range = (recordRange*) state;
+	if(range->skip > 0) {
+		unsigned int skipped = range->skip < count ? (unsigned int) range->skip : count;
+		range->skip -= skipped;
+		range->position += skipped;
+		recs += skipped;
+		count -= skipped;
+	}
+	if(range->limited) {
+		if(count >= range->left) {
+			count = (unsigned int) range->left;
+			replayStopped = 1;
+		}
+		range->left -= count;
+	}
+	if(count > 0) {
+		range->position += count;
+		range->sink(range->state, recs, count);
+	}
+}
+
+/**
+ * Replay a text or binary trace into a sink, through the filter if it has
+ * anything to do and the progress meter if -I asked for one. The records
+ * options->skip covers are passed over, and options->position is left at
+ * where the replay got to, with the marker window state in options->inWindow.
+ */
+int replayTrace(char* file, int binary, traceFilter* options, recordSink sink, void* state) {
+	traceFilter* filter = NULL;
+	if(options->active) {
+		filter = (traceFilter*) malloc(sizeof(traceFilter));
+		*filter = *options;
+		filter->sink = sink;
+		filter->state = state;
+		sink = filterRecords;
+		state = filter;
+	}
+	recordRange range;
+	memset(&range, 0, sizeof(range));
+	range.skip = binary ? 0 : options->skip; // binary traces start at the right block instead
+	range.position = binary ? options->skip : 0;
+	range.left = options->maxRecords;
+	range.limited = options->maxRecords > 0;
+	range.sink = sink;
+	range.state = state;
+	sink = rangeRecords;
+	state = &range;
+	replayStopped = 0;
+	progressMeter meter;
+	if(options->progress > 0) {
+		memset(&meter, 0, sizeof(meter));
+		meter.interval = options->progress;
+		meter.start = meter.last = now();
+		meter.nextCheck = PROGRESS_STRIDE;
+		meter.sink = sink;
+		meter.state = state;
+		sink = progressRecords;
+		state = &meter;
+	}
+	int status = binary ? processBinaryFile(file, options->skip, sink, state) : processFile(file, sink, state);
+	if(options->progress > 0) {
+		reportProgress(&meter, now(), " (done)");
+	}
+	options->position = range.position;
+	if(filter != NULL) {
+		options->inWindow = filter->inWindow;
+	}
+	free(filter);
+	return status;
+}
+
+/**
+ * Replay one trace per core, taking a record from each in turn
+ */
+int processCoherent(coherentSystem* sys, char** files, const int* binaries, int numFiles, traceFilter* filter) {
+	traceLog* logs = (traceLog*) calloc(numFiles, sizeof(traceLog));
+	int status = 0;
+
+	for(int i = 0; i < numFiles && status == 0; i++) {
+		filter->inWindow = 0; // every core's trace starts outside the window
+		status = replayTrace(files[i], binaries[i], filter, logRecords, &logs[i]);
+	}
+	for(size_t r = 0, more = status == 0; more; r++) {
+		more = 0;
+		for(int i = 0; i < numFiles; i++) {
+			if(r < logs[i].count) {
+				coherentRecord(sys, i, &logs[i].recs[r]);
+				more = 1;
+			}
+		}
+	}
+	for(int i = 0; i < numFiles; i++) {
+		free(logs[i].recs);
+	}
+	free(logs);
+	return status;
+}
+
+/*
+ * print out the program usage
+ */
+void printUsage() {
+	puts("USAGE:");
+	puts("./csim [-hvce] [-j <threads>] [-p <policy>] [-w <write policy>] [-F <prefetcher>] [-C <s>,<E>,<b>]... -s <s> (-E <E> | -A <minE>-<maxE>) -b <b> (-t <tracefile> | -T <binarytrace>)");
+	puts("./csim -r -b <b> (-t <tracefile> | -T <binarytrace>)");
+	puts("./csim -H <hierarchy> (-t <tracefile> | -T <binarytrace>)");
+	puts("./csim [-v] [-j <threads>] [-S <checkpoint>] (-R <checkpoint> | [-p <policy>] [-w <write policy>] -s <s> -E <E> -b <b>) (-t <tracefile> | -T <binarytrace>)");
+	puts("./csim [-v] -Z <period>,<window>[,<warmup>] [-p <policy>] [-w <write policy>] -s <s> -E <E> -b <b> (-t <tracefile> | -T <binarytrace>)");
+	puts("./csim [-v] -P <protocol> [-p <policy>] -s <s> -E <E> -b <b> [-L <s>,<E>,<b>] (-t <tracefile> | -T <binarytrace>)...");
+	puts("Any of them also take [-m <start>,<end>] [-f <limit>] to filter the trace as it's read,");
+	puts("[-n <records>] to stop early, and [-I <seconds>] to report progress on stderr.");
+	puts("Where...");
+	puts("\t• -h: Optional help flag that prints usage info\n"
+			"\t• -v: Optional verbose flag that displays trace info\n"
+			"\t• -c: Classify the misses as compulsory, capacity or conflict, overall and\n"
+			"\t  for each -m window\n"
+			"\t• -e: Print how many accesses block-run folding counted as hits without looking\n"
+			"\t  them up (repeats of the block just used; CSIM_FOLD=off turns it off)\n"
+			"\t• -j <threads>: Split the sets across this many worker threads (ignored with -v, -c, -F, -C or -Z)\n"
+			"\t• -p <policy>: Replacement policy: lru (default), fifo, random, plru, nru, srrip, brrip or lfu\n"
+			"\t• -w <write policy>: wb (write-back, the default) or wt (write-through), and\n"
+			"\t  wa (write-allocate, the default) or nwa (no-write-allocate); may be repeated\n"
+			"\t• -F <prefetcher>: next, adjacent or stride, optionally followed by :degree=<n>,\n"
+			"\t  distance=<n>, streams=<n> and latency=<n> (see prefetch.h)\n"
+			"\t• -s <s>: Number of set index bits (the number of sets is 2^s)\n"
+			"\t• -E <E>: Associativity (number of lines per set)\n"
+			"\t• -A <minE>-<maxE>: Simulate every associativity in the range in one pass\n"
+			"\t• -b <b>: Number of block bits (the block size is 2^b)\n"
+			"\t• -r: Print the reuse distance histogram of the trace's blocks and the miss\n"
+			"\t  ratio curve of fully associative LRU caches of every size\n"
+			"\t• -C <s>,<E>,<b>: Also simulate a cache with this geometry on the same trace\n"
+			"\t• -m <start>,<end>: Only replay accesses from one to address start through one\n"
+			"\t  to address end (hex), every time start comes around\n"
+			"\t• -f <limit>: Drop accesses at or above this address (hex), e.g. ffffffff to\n"
+			"\t  skip the stack in valgrind traces\n"
+			"\t• -n <records>: Stop after this many records of the trace (after the ones a\n"
+			"\t  checkpoint covers)\n"
+			"\t• -S <checkpoint>: Save the cache, its counters and the place in the trace to this\n"
+			"\t  file when the replay stops\n"
+			"\t• -R <checkpoint>: Start from a checkpoint made by -S, with its cache and policies,\n"
+			"\t  picking the trace up where it stopped\n"
+			"\t• -Z <period>,<window>[,<warmup>]: Sample the trace: measure the last window\n"
+			"\t  records of every period, after simulating the warmup records before them\n"
+			"\t  (default: all of them) and passing over the rest, and report the miss ratio\n"
+			"\t  with a 95% confidence interval\n"
+			"\t• -I <seconds>: Print the records read so far and the rate on stderr this\n"
+			"\t  often, and once more at the end\n"
+			"\t• -H <hierarchy>: Simulate a multi-level hierarchy described in this file, or in\n"
+			"\t  the argument itself with levels separated by ';' (see hierarchy.h)\n"
+			"\t• -P <protocol>: Simulate one coherent private cache per trace with mesi or moesi\n"
+			"\t  (-v lists every contended line)\n"
+			"\t• -L <s>,<E>,<b>: Geometry of a last level cache shared by the cores under -P\n"
+			"\t• -t <tracefile>: Name of the valgrind trace to replay (\"-\" reads stdin; pipes\n"
+			"\t  and FIFOs are simulated as they're written)\n"
+			"\t• -T <binarytrace>: Name of a binary trace made by tracepack to replay");
 }
 
 int main(int argc, char* argv[]) {
 	cacheInfo info;
-	Cache* cache;
-	char* file;
-	int opt;
-	char verbose;
+	char* file = NULL;
+	char* files[MAX_CORES]; // every trace given, one per core under -P
+	int binaries[MAX_CORES];
+	int numFiles = 0;
+	int opt, status;
+	char verbose = 0;
+	int binary = 0;
+	int minE = 0, maxE = 0;
+	int threads = 1;
+	int policy = POLICY_LRU;
+	int writeBack = 1, writeAllocate = 1;
+	char* hierarchySpec = NULL;
+	int protocol = -1;
+	cacheInfo llcInfo;
+	int llc = 0;
+	traceFilter filter;
+	cacheInfo configs[MAX_CONFIGS]; // extra caches from -C
+	int numConfigs = 0;
+	int classify = 0;
+	int reuse = 0;
+	char* prefetchSpec = NULL;
+	char* checkpointFile = NULL; // -S
+	char* restoreFile = NULL; // -R
+	sampler samp; // -Z
+	int showFolded = 0; // -e
+	unsigned long long folded = 0; // accesses block-run folding counted without the cache
+
+	memset(&filter, 0, sizeof(filter));
+	memset(&info, 0, sizeof(info));
+	memset(&samp, 0, sizeof(samp));
 
 	// use getopt to read optional flags and their values
-	while((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+	while((opt = getopt(argc, argv, "hvcerj:p:w:F:s:E:A:b:C:m:f:I:n:S:R:Z:H:P:L:t:T:")) != -1) {
 		switch(opt) {
 		case 'h':
 			printUsage();
@@ -210,17 +1103,130 @@ int main(int argc, char* argv[]) {
 		case 'v':
 			verbose = 1;
 			break;
+		case 'c':
+			classify = 1;
+			break;
+		case 'e':
+			showFolded = 1;
+			break;
+		case 'r':
+			reuse = 1;
+			break;
+		case 'F':
+			prefetchSpec = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 'p':
+			policy = parsePolicy(optarg);
+			if(policy < 0) {
+				printf("Unknown replacement policy %s.\n", optarg);
+				printUsage();
+				return 1;
+			}
+			break;
+		case 'w':
+			if(parseWritePolicy(optarg, &writeBack, &writeAllocate) != 0) {
+				printf("Unknown write policy %s.\n", optarg);
+				printUsage();
+				return 1;
+			}
+			break;
 		case 's':
 			info.s = atoi(optarg);
 			break;
 		case 'E':
 			info.E = atoi(optarg);
 			break;
+		case 'A':
+			if(sscanf(optarg, "%d-%d", &minE, &maxE) != 2) { // a single number means 1 up to it
+				minE = 1;
+				maxE = atoi(optarg);
+			}
+			break;
 		case 'b':
 			info.b = atoi(optarg);
 			break;
+		case 'C':
+			if(numConfigs == MAX_CONFIGS) {
+				printf("At most %d extra caches are supported.\n", MAX_CONFIGS);
+				return 1;
+			}
+			memset(&configs[numConfigs], 0, sizeof(cacheInfo));
+			if(sscanf(optarg, "%d,%d,%d", &configs[numConfigs].s, &configs[numConfigs].E, &configs[numConfigs].b) != 3) {
+				puts("Each extra cache needs s, E and b.");
+				return 1;
+			}
+			configs[numConfigs].S = 1 << configs[numConfigs].s;
+			configs[numConfigs].B = 1 << configs[numConfigs].b;
+			numConfigs++;
+			break;
+		case 'm':
+			if(sscanf(optarg, "%llx,%llx", &filter.markerStart, &filter.markerEnd) != 2) {
+				puts("The marker window needs a start and an end address.");
+				return 1;
+			}
+			filter.windowed = filter.active = 1;
+			break;
+		case 'f':
+			filter.limit = strtoull(optarg, NULL, 16);
+			filter.active = 1;
+			break;
+		case 'I':
+			filter.progress = atof(optarg);
+			if(filter.progress <= 0) {
+				puts("The progress interval needs to be a positive number of seconds.");
+				return 1;
+			}
+			break;
+		case 'n':
+			filter.maxRecords = strtoull(optarg, NULL, 10);
+			break;
+		case 'S':
+			checkpointFile = optarg;
+			break;
+		case 'R':
+			restoreFile = optarg;
+			break;
+		case 'Z': {
+			int fields = sscanf(optarg, "%llu,%llu,%llu", &samp.period, &samp.window, &samp.warmup);
+			if(fields < 2 || samp.window == 0 || samp.window > samp.period
+					|| (fields == 3 && samp.warmup > samp.period - samp.window)) {
+				puts("Sampling needs a period, a window no longer than it and optionally a warmup that fits before the window.");
+				return 1;
+			}
+			if(fields == 2) { // keep the cache warm through the whole gap
+				samp.warmup = samp.period - samp.window;
+			}
+			break;
+		}
+		case 'H':
+			hierarchySpec = optarg;
+			break;
+		case 'P':
+			protocol = parseProtocol(optarg);
+			if(protocol < 0) {
+				printf("Unknown coherence protocol %s.\n", optarg);
+				printUsage();
+				return 1;
+			}
+			break;
+		case 'L':
+			if(sscanf(optarg, "%d,%d,%d", &llcInfo.s, &llcInfo.E, &llcInfo.b) != 3) {
+				puts("The shared cache needs s, E and b.");
+				return 1;
+			}
+			llc = 1;
+			break;
 		case 't':
-			file = optarg;
+		case 'T':
+			if(numFiles == MAX_CORES) {
+				printf("At most %d traces are supported.\n", MAX_CORES);
+				return 1;
+			}
+			files[numFiles] = optarg;
+			binaries[numFiles++] = opt == 'T';
 			break;
 		default:
 			puts("Found incorrect value.\n");
@@ -229,16 +1235,227 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	if(numFiles == 0) { // nothing to replay
+		printUsage();
+		return 1;
+	}
+	if(numFiles > 1 && protocol < 0) {
+		puts("Only -P replays more than one trace.");
+		return 1;
+	}
+	file = files[0];
+	binary = binaries[0];
+	if((checkpointFile != NULL || restoreFile != NULL || samp.period > 0)
+			&& (hierarchySpec != NULL || protocol >= 0 || reuse || maxE > 0 || numConfigs > 0 || classify || prefetchSpec != NULL)) {
+		puts("Checkpoints and sampling need a single cache, without -H, -P, -r, -A, -C, -c or -F.");
+		return 1;
+	}
+	if(samp.period > 0 && (checkpointFile != NULL || restoreFile != NULL)) {
+		puts("Sampled runs can't be checkpointed.");
+		return 1;
+	}
+
+	if(hierarchySpec != NULL) { // every level has its own geometry, so -s/-E/-b don't apply
+		cacheHierarchy* hier = newHierarchy(hierarchySpec);
+		if(hier == NULL) {
+			return 1;
+		}
+		status = replayTrace(file, binary, &filter, hierarchyRecords, hier);
+		finishHierarchy(hier);
+		cleanHierarchy(hier);
+		return status == 0 ? 0 : 1;
+	}
+
 	info.S = 1 << info.s;  // find out the proper S value
 	info.B = 1 << info.b; // find out the proper B value
 	info.numEvicts = 0; //
 	info.numHits = 0;   // reset each counter to 0
 	info.numMisses = 0; //
+	info.numDirtyEvicts = 0;
+	info.bytesRead = 0;
+	info.bytesWritten = 0;
+
+	if(protocol >= 0) { // one private cache per trace
+		if(llc) {
+			llcInfo.S = 1 << llcInfo.s;
+			llcInfo.B = 1 << llcInfo.b;
+			llcInfo.numHits = llcInfo.numMisses = llcInfo.numEvicts = llcInfo.numDirtyEvicts = 0;
+			llcInfo.bytesRead = llcInfo.bytesWritten = 0;
+		}
+		coherentSystem* sys = newCoherentSystem(info, policy, numFiles, protocol, llc ? &llcInfo : NULL);
+		if(sys == NULL) {
+			return 1;
+		}
+		status = processCoherent(sys, files, binaries, numFiles, &filter);
+		printCoherentSummary(sys, verbose);
+		cleanCoherentSystem(sys);
+		return status == 0 ? 0 : 1;
+	}
+
+	if(reuse) { // one profile covers every fully associative size, so -s and -E don't apply
+		reuseProfile* profile = newReuseProfile(info.b);
+		if(profile == NULL) {
+			return 1;
+		}
+		status = replayTrace(file, binary, &filter, reuseRecords, profile);
+		printReuseProfile(profile);
+		cleanReuseProfile(profile);
+		return status == 0 ? 0 : 1;
+	}
+
+	if(maxE > 0) { // sweep every associativity in one pass instead of simulating one cache
+		if(minE < 1 || minE > maxE) {
+			puts("Invalid associativity range.");
+			return 1;
+		}
+		if(policy != POLICY_LRU) { // the stack algorithm only works for LRU
+			puts("Associativity sweeps need the lru policy.");
+			return 1;
+		}
+		stackSweep* sweep = newSweep(info, minE, maxE);
+		status = replayTrace(file, binary, &filter, sweepRecords, sweep);
+		for(int E = minE; E <= maxE; E++) {
+			cacheInfo result = sweepResult(sweep, info, E);
+			printf("E:%d hits:%llu misses:%llu evictions:%llu\n", E, result.numHits, result.numMisses, result.numEvicts);
+		}
+		cleanSweep(sweep);
+		return status == 0 ? 0 : 1;
+	}
 
-	cache = newCache(info);
-	info = processFile(cache, info, verbose, file); // read the file and subsequently run the simulation
+	if(threads > info.S) { // no point in a worker without any sets
+		threads = info.S;
+	}
+	if(threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+
+	Cache* cache;
+	if(restoreFile != NULL) { // the checkpoint says what the cache is and where in the trace to pick up
+		cacheInfo given = info;
+		cache = loadCheckpoint(restoreFile, &info, &filter);
+		if(cache == NULL) {
+			return 1;
+		}
+		if((given.s && given.s != info.s) || (given.E && given.E != info.E) || (given.b && given.b != info.b)) {
+			printf("The checkpoint is of a %d,%d,%d cache.\n", info.s, info.E, info.b);
+			cleanCache(cache, info);
+			return 1;
+		}
+		if(threads > info.S) {
+			threads = info.S;
+		}
+	}
+	else {
+		cache = newCache(info, policy);
+		if(cache == NULL) {
+			return 1;
+		}
+		cache->writeBack = writeBack;
+		cache->writeAllocate = writeAllocate;
+	}
+	missClassifier* classifier = NULL;
+	if(classify) {
+		classifier = newClassifier(info, writeAllocate);
+		if(classifier == NULL) {
+			return 1;
+		}
+	}
+	prefetcher* prefetch = NULL;
+	if(prefetchSpec != NULL) {
+		prefetch = newPrefetcher(prefetchSpec);
+		if(prefetch == NULL) {
+			return 1;
+		}
+	}
+	unsigned long long before = info.numHits + info.numMisses; // a checkpoint's accesses aren't this run's
+	if(numConfigs > 0) { // one reader feeding every cache
+		simState sims[1 + MAX_CONFIGS];
+		fanOut fan = { sims, 1 + numConfigs };
+		sims[0].cache = cache;
+		sims[0].info = info;
+		sims[0].verbose = verbose;
+		sims[0].classifier = classifier;
+		sims[0].prefetch = prefetch;
+		sims[0].regions = filter.windowed;
+		sims[0].regionStart = filter.markerStart;
+		initBlockRun(&sims[0].run, cache);
+		for(int i = 0; i < numConfigs; i++) {
+			sims[i + 1].cache = newCache(configs[i], policy);
+			if(sims[i + 1].cache == NULL) {
+				return 1;
+			}
+			sims[i + 1].cache->writeBack = writeBack;
+			sims[i + 1].cache->writeAllocate = writeAllocate;
+			sims[i + 1].info = configs[i];
+			sims[i + 1].verbose = 0; // only the main cache explains itself
+			sims[i + 1].classifier = NULL;
+			sims[i + 1].prefetch = NULL;
+			initBlockRun(&sims[i + 1].run, sims[i + 1].cache);
+		}
+		status = replayTrace(file, binary, &filter, fanOutRecords, &fan);
+		info = sims[0].info;
+		folded = sims[0].run.folded;
+		for(int i = 0; i < numConfigs; i++) {
+			configs[i] = sims[i + 1].info;
+			cleanCache(sims[i + 1].cache, configs[i]);
+		}
+	}
+	else if(threads > 1 && !verbose && !classify && prefetch == NULL && samp.period == 0) { // verbose output has to come out in trace order, so it stays on one thread
+		parallelSim* par = newParallelSim(cache, info, threads);
+		status = replayTrace(file, binary, &filter, shardRecords, par);
+		info = finishParallelSim(par, info, &folded);
+	}
+	else {
+		simState sim;
+		sim.cache = cache;
+		sim.info = info;
+		sim.verbose = verbose;
+		sim.classifier = classifier;
+		sim.prefetch = prefetch;
+		sim.regions = filter.windowed;
+		sim.regionStart = filter.markerStart;
+		initBlockRun(&sim.run, cache);
+		if(samp.period > 0) {
+			samp.sim = &sim;
+			status = replayTrace(file, binary, &filter, sampleRecords, &samp);
+			info = samp.measured; // only the windows count
+			before -= sim.info.numHits + sim.info.numMisses - info.numHits - info.numMisses; // but the warmups were simulated too
+		}
+		else {
+			status = replayTrace(file, binary, &filter, simulateRecords, &sim); // read the file and subsequently run the simulation
+			info = sim.info;
+		}
+		folded = sim.run.folded;
+	}
+	int unsaved = checkpointFile != NULL && (status != 0 || saveCheckpoint(checkpointFile, cache, info, &filter) != 0);
 	cleanCache(cache, info);
 
 	printSummary(info.numHits, info.numMisses, info.numEvicts);
-	return 0;
+	printTrafficSummary(NULL, info.numDirtyEvicts, info.bytesRead, info.bytesWritten);
+	if(samp.period > 0) {
+		printSampleSummary(&samp);
+	}
+	if(showFolded) {
+		unsigned long long accesses = info.numHits + info.numMisses - before;
+		printf("folded:%llu accesses:%llu (%.1f%% counted without a lookup)\n", folded, accesses,
+				accesses > 0 ? 100.0 * folded / accesses : 0);
+	}
+	if(checkpointFile != NULL && !unsaved) {
+		printf("checkpoint: %llu records in %s\n", filter.position, checkpointFile);
+	}
+	if(classifier != NULL) {
+		printClassSummary(classifier, NULL);
+		cleanClassifier(classifier);
+	}
+	if(prefetch != NULL) {
+		printPrefetchSummary(prefetch, NULL);
+		cleanPrefetcher(prefetch);
+	}
+	for(int i = 0; i < numConfigs; i++) {
+		char name[48];
+		snprintf(name, sizeof(name), "%d,%d,%d", configs[i].s, configs[i].E, configs[i].b);
+		printLevelSummary(name, configs[i].numHits, configs[i].numMisses, configs[i].numEvicts);
+		printTrafficSummary(name, configs[i].numDirtyEvicts, configs[i].bytesRead, configs[i].bytesWritten);
+	}
+	return unsaved;
 }
@@ -5,7 +5,8 @@
 #     function. It uses ./test-csim to check the correctness of the
 #     simulator and it runs ./test-trans on three different sized
 #     matrices (32x32, 64x64, and 61x67) to test the correctness and
-#     performance of the transpose function.
+#     performance of the transpose function. All four run at once,
+#     and their results are reported in the same order as ever.
 #
 import subprocess;
 import re;
@@ -47,12 +48,19 @@ def main():
     opts, args = p.parse_args()
     autograde = opts.autograde
 
+    # Start the simulator test and the three transpose tests together;
+    # none of them shares a file with another
+    csim = subprocess.Popen("./test-csim", 
+                            shell=True, stdout=subprocess.PIPE)
+    trans = {}
+    for (m, n) in [(32, 32), (64, 64), (61, 67)]:
+        trans[m] = subprocess.Popen("./test-trans -M %d -N %d | grep TEST_TRANS_RESULTS" % (m, n),
+                                    shell=True, stdout=subprocess.PIPE)
+
     # Check the correctness of the cache simulator
     print "Part A: Testing cache simulator"
     print "Running ./test-csim"
-    p = subprocess.Popen("./test-csim", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
+    stdout_data = csim.communicate()[0]
 
     # Emit the output from test-csim
     stdout_data = re.split('\n', stdout_data)
@@ -66,23 +74,17 @@ def main():
     # 32x32 transpose
     print "Part B: Testing transpose function"
     print "Running ./test-trans -M 32 -N 32"
-    p = subprocess.Popen("./test-trans -M 32 -N 32 | grep TEST_TRANS_RESULTS", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
+    stdout_data = trans[32].communicate()[0]
     result32 = re.findall(r'(\d+)', stdout_data)
     
     # 64x64 transpose
     print "Running ./test-trans -M 64 -N 64"
-    p = subprocess.Popen("./test-trans -M 64 -N 64 | grep TEST_TRANS_RESULTS", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
+    stdout_data = trans[64].communicate()[0]
     result64 = re.findall(r'(\d+)', stdout_data)
     
     # 61x67 transpose
     print "Running ./test-trans -M 61 -N 67"
-    p = subprocess.Popen("./test-trans -M 61 -N 67 | grep TEST_TRANS_RESULTS", 
-                         shell=True, stdout=subprocess.PIPE)
-    stdout_data = p.communicate()[0]
+    stdout_data = trans[61].communicate()[0]
     result61 = re.findall(r'(\d+)', stdout_data)
     
     # Compute the scores for each step
@@ -0,0 +1,399 @@
+/*
+ * hierarchy.c - Multi-level cache hierarchies for csim
+ *
+ * Misses flow down in batches: each level queues the requests coming from
+ * the level above and runs them all at once when the queue fills, so a
+ * deep hierarchy touches one level's state at a time. Requests are kept in
+ * trace order, which makes this exact for nine levels. An inclusive level
+ * reaches back up into the levels above when it evicts, so it and every
+ * level above it run each request straight away. So does an exclusive
+ * level, which hands a dirty block up by marking the line just filled with it.
+ *
+ * A level sends down a read for every block it fills, the stores it writes
+ * through or around, and its dirty victims as writebacks. Writebacks and
+ * victims headed for an exclusive level are placed without counting as hits
+ * or misses there. Only reads take a block back out of an exclusive level: a
+ * store that reaches one came from a level that didn't take the block, so
+ * it updates the line in place.
+ */
+#define _DEFAULT_SOURCE
+#include "hierarchy.h"
+#include "cachelab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void runLevel(cacheHierarchy* hier, int index);
+
+/*
+ * The level a level's misses, stores and victims go to
+ */
+static int levelBelow(cacheHierarchy* hier, int index) {
+	return index < hier->numFirst ? hier->numFirst : index + 1;
+}
+
+/*
+ * Queue a request for a level and run the level once the queue is full
+ */
+static void sendDown(cacheHierarchy* hier, int index, unsigned long long address, int request, unsigned int size) {
+	if(index >= hier->numLevels) {
+		return; // main memory always hits
+	}
+	cacheLevel* level = &hier->levels[index];
+	level->pending[level->numPending] = address;
+	level->pendingRequest[level->numPending] = request;
+	level->pendingSize[level->numPending] = size;
+	if(++level->numPending == level->batch) {
+		runLevel(hier, index);
+	}
+}
+
+/*
+ * Drop a block (and every smaller block inside it) from the levels above an
+ * inclusive level. Dirty copies can't stay behind, so they go to the level below.
+ */
+static void backInvalidate(cacheHierarchy* hier, int index, unsigned long long address) {
+	cacheLevel* lower = &hier->levels[index];
+	for(int i = 0; i < index; i++) {
+		cacheLevel* upper = &hier->levels[i];
+		unsigned long long step = 1ULL << upper->info.b;
+		unsigned long long end = address + lower->info.B;
+		for(unsigned long long a = address & ~(step - 1); a < end; a += step) {
+			int state = invalidateBlock(upper->cache, upper->info, a);
+			lower->backInvalidations += state != 0;
+			if(state == 2) {
+				upper->info.bytesWritten += upper->info.B;
+				sendDown(hier, index + 1, a, REQUEST_WRITEBACK, upper->info.B);
+			}
+		}
+	}
+}
+
+/*
+ * What happens to a block a level has just evicted
+ */
+static void evicted(cacheHierarchy* hier, int index, unsigned long long victim, int dirty) {
+	cacheLevel* level = &hier->levels[index];
+	if(level->inclusion == INCLUSION_INCLUSIVE) {
+		backInvalidate(hier, index, victim);
+	}
+	int below = levelBelow(hier, index);
+	if(dirty) {
+		sendDown(hier, below, victim, REQUEST_WRITEBACK, level->info.B);
+	}
+	else if(below < hier->numLevels && hier->levels[below].inclusion == INCLUSION_EXCLUSIVE) {
+		sendDown(hier, below, victim, REQUEST_INSTALL, level->info.B); // the level below is a victim cache
+	}
+}
+
+/*
+ * Run one request through a level's cache and pass on whatever it sends down
+ */
+static void accessLevel(cacheHierarchy* hier, int index, unsigned long long address, int request, unsigned int size) {
+	cacheLevel* level = &hier->levels[index];
+	unsigned long long victim;
+	int result = accessCache(level->cache, &level->info, address, request, size, 0, &victim);
+	int below = levelBelow(hier, index);
+
+	if(result & ACCESS_FILL) {
+		sendDown(hier, below, address, REQUEST_READ, level->info.B);
+	}
+	if(result & ACCESS_FORWARD) { // a written-through writeback is still a writeback below
+		sendDown(hier, below, address, request == REQUEST_WRITEBACK ? REQUEST_WRITEBACK : REQUEST_WRITE, size);
+	}
+	if(result & ACCESS_EVICT) {
+		evicted(hier, index, victim, result & ACCESS_DIRTY);
+	}
+}
+
+/*
+ * Move the dirty state of a block an exclusive level hands up onto the line
+ * the level above filled with it, past any exclusive levels in between,
+ * which don't keep what they pass up. Returns 0 if no level above can take
+ * it: the line has already left, it's smaller than the block or it's
+ * written through.
+ */
+static int handUpDirty(cacheHierarchy* hier, int index, unsigned long long address) {
+	cacheLevel* level = &hier->levels[index];
+	for(int i = 0; i < index; i++) {
+		cacheLevel* upper = &hier->levels[i];
+		int below = levelBelow(hier, i);
+		while(below < index && hier->levels[below].inclusion == INCLUSION_EXCLUSIVE) {
+			below = levelBelow(hier, below);
+		}
+		if(below != index || upper->inclusion == INCLUSION_EXCLUSIVE || upper->info.b < level->info.b || !upper->writeBack) {
+			continue;
+		}
+		unsigned char* line = lineState(upper->cache, upper->info, address);
+		if(line != NULL) {
+			*line |= LINE_DIRTY;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Run every request queued for a level below the first, in order
+ */
+static void runLevel(cacheHierarchy* hier, int index) {
+	cacheLevel* level = &hier->levels[index];
+
+	for(int i = 0; i < level->numPending; i++) {
+		unsigned long long address = level->pending[i];
+		int request = level->pendingRequest[i];
+		unsigned int size = level->pendingSize[i];
+
+		if(level->inclusion == INCLUSION_EXCLUSIVE && request == REQUEST_READ) { // a hit hands the block up to the level above
+			int state = invalidateBlock(level->cache, level->info, address);
+			if(state != 0) {
+				level->info.numHits++;
+			}
+			else {
+				level->info.numMisses++;
+				level->info.bytesRead += level->info.B; // it passes through on its way up
+				sendDown(hier, index + 1, address, request, size);
+			}
+			if(state == 2 && !handUpDirty(hier, index, address)) { // nowhere above can hold the dirty data, so it goes down
+				level->info.bytesWritten += level->info.B;
+				sendDown(hier, index + 1, address, REQUEST_WRITEBACK, level->info.B);
+			}
+		}
+		else if(level->inclusion == INCLUSION_EXCLUSIVE && request == REQUEST_WRITE) { // a store from a level that didn't take the block
+			unsigned char* line = lineState(level->cache, level->info, address);
+			if(line != NULL) {
+				level->info.numHits++;
+			}
+			else {
+				level->info.numMisses++;
+			}
+			if(line != NULL && level->writeBack) { // update the line where it is
+				*line |= LINE_DIRTY;
+			}
+			else {
+				level->info.bytesWritten += size;
+				sendDown(hier, index + 1, address, REQUEST_WRITE, size);
+			}
+		}
+		else {
+			accessLevel(hier, index, address, request, size);
+		}
+	}
+	level->numPending = 0;
+}
+
+void hierarchyRecords(void* state, const traceRecord* recs, unsigned int count) {
+	cacheHierarchy* hier = (cacheHierarchy*) state;
+	for(unsigned int i = 0; i < count; i++) {
+		switch(recs[i].op) {
+		case 'I':
+			if(hier->instIndex >= 0) {
+				accessLevel(hier, hier->instIndex, recs[i].address, REQUEST_READ, recs[i].len);
+			}
+			break;
+		case 'M': // a load and then a store
+			accessLevel(hier, hier->dataIndex, recs[i].address, REQUEST_READ, recs[i].len);
+			accessLevel(hier, hier->dataIndex, recs[i].address, REQUEST_WRITE, recs[i].len);
+			break;
+		case 'L':
+			accessLevel(hier, hier->dataIndex, recs[i].address, REQUEST_READ, recs[i].len);
+			break;
+		case 'S':
+			accessLevel(hier, hier->dataIndex, recs[i].address, REQUEST_WRITE, recs[i].len);
+			break;
+		}
+	}
+}
+
+/*
+ * Parse one "name s E b [policy] [inclusion] [write policy...]" line into the next level. Returns 0 on success.
+ */
+static int parseLevel(cacheHierarchy* hier, char* line) {
+	char* fields[8];
+	int numFields = 0;
+
+	for(char* tok = strtok(line, " \t,"); tok != NULL; tok = strtok(NULL, " \t,")) {
+		if(tok[0] == '#') {
+			break; // the rest of the line is a comment
+		}
+		if(numFields == 8) {
+			printf("Too many fields for level %s.\n", fields[0]);
+			return -1;
+		}
+		fields[numFields++] = tok;
+	}
+	if(numFields == 0) {
+		return 0; // blank line
+	}
+	if(numFields < 4) {
+		printf("Level %s needs a name, s, E and b.\n", fields[0]);
+		return -1;
+	}
+	if(hier->numLevels == MAX_LEVELS) {
+		printf("At most %d levels are supported.\n", MAX_LEVELS);
+		return -1;
+	}
+
+	cacheLevel* level = &hier->levels[hier->numLevels];
+	snprintf(level->name, sizeof(level->name), "%s", fields[0]);
+	level->info.s = atoi(fields[1]);
+	level->info.E = atoi(fields[2]);
+	level->info.b = atoi(fields[3]);
+	level->policy = POLICY_LRU;
+	level->inclusion = INCLUSION_NINE;
+	level->writeBack = 1;
+	level->writeAllocate = 1;
+
+	for(int i = 4; i < numFields; i++) {
+		int policy = parsePolicy(fields[i]);
+		if(policy >= 0) {
+			level->policy = policy;
+		}
+		else if(strcmp(fields[i], "nine") == 0) {
+			level->inclusion = INCLUSION_NINE;
+		}
+		else if(strcmp(fields[i], "inclusive") == 0) {
+			level->inclusion = INCLUSION_INCLUSIVE;
+		}
+		else if(strcmp(fields[i], "exclusive") == 0) {
+			level->inclusion = INCLUSION_EXCLUSIVE;
+		}
+		else if(parseWritePolicy(fields[i], &level->writeBack, &level->writeAllocate) != 0) {
+			printf("Unknown policy or inclusion %s for level %s.\n", fields[i], level->name);
+			return -1;
+		}
+	}
+
+	if(level->info.s < 0 || level->info.E < 1 || level->info.b < 0 || level->info.s + level->info.b >= 64) {
+		printf("Bad geometry for level %s.\n", level->name);
+		return -1;
+	}
+	level->info.S = 1 << level->info.s;
+	level->info.B = 1 << level->info.b;
+	hier->numLevels++;
+	return 0;
+}
+
+/*
+ * Work out which levels are the first level caches and check the rest
+ */
+static int checkLevels(cacheHierarchy* hier) {
+	cacheLevel* levels = hier->levels;
+
+	if(hier->numLevels == 0) {
+		puts("The hierarchy has no levels.");
+		return -1;
+	}
+
+	hier->instIndex = -1;
+	hier->dataIndex = 0;
+	hier->numFirst = 1;
+	if(hier->numLevels >= 2 && strcmp(levels[0].name, "L1I") == 0 && strcmp(levels[1].name, "L1D") == 0) {
+		hier->instIndex = 0;
+		hier->dataIndex = 1;
+		hier->numFirst = 2;
+	}
+	else if(hier->numLevels >= 2 && strcmp(levels[0].name, "L1D") == 0 && strcmp(levels[1].name, "L1I") == 0) {
+		hier->instIndex = 1;
+		hier->numFirst = 2;
+	}
+
+	for(int i = 0; i < hier->numLevels; i++) {
+		if(i < hier->numFirst && levels[i].inclusion != INCLUSION_NINE) {
+			printf("Level %s is a first level cache, so it can't be inclusive or exclusive.\n", levels[i].name);
+			return -1;
+		}
+		if(levels[i].inclusion == INCLUSION_EXCLUSIVE) {
+			for(int j = 0; j < i; j++) { // blocks move whole between an exclusive level and the ones above
+				if(levels[j].info.b != levels[i].info.b) {
+					printf("Exclusive level %s needs the same block size as %s.\n", levels[i].name, levels[j].name);
+					return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+cacheHierarchy* newHierarchy(const char* spec) {
+	cacheHierarchy* hier = (cacheHierarchy*) calloc(1, sizeof(cacheHierarchy));
+	char* text;
+	FILE* fp = fopen(spec, "r");
+
+	if(fp != NULL) { // a description file
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp);
+		rewind(fp);
+		text = (char*) malloc(size + 1);
+		size = fread(text, 1, size, fp);
+		text[size] = '\0';
+		fclose(fp);
+	}
+	else { // the description itself, with ';' between levels
+		text = strdup(spec);
+	}
+
+	int status = 0;
+	char* rest = text;
+	while(status == 0 && rest != NULL) {
+		char* line = rest;
+		rest = strpbrk(rest, ";\n");
+		if(rest != NULL) {
+			*rest++ = '\0';
+		}
+		status = parseLevel(hier, line);
+	}
+	free(text);
+
+	if(status != 0 || checkLevels(hier) != 0) {
+		free(hier);
+		return NULL;
+	}
+
+	int inclusiveBelow = 0;
+	for(int i = hier->numLevels - 1; i >= 0; i--) { // anything above an inclusive level can't run ahead of it
+		inclusiveBelow |= hier->levels[i].inclusion == INCLUSION_INCLUSIVE;
+		int handsUp = hier->levels[i].inclusion == INCLUSION_EXCLUSIVE; // its hits reach the line the level above just filled
+		hier->levels[i].batch = inclusiveBelow || handsUp ? 1 : HIERARCHY_BATCH;
+	}
+
+	for(int i = 0; i < hier->numLevels; i++) {
+		cacheLevel* level = &hier->levels[i];
+		level->cache = newCache(level->info, level->policy);
+		if(level->cache == NULL) {
+			hier->numLevels = i; // only free the levels that were built
+			cleanHierarchy(hier);
+			return NULL;
+		}
+		level->cache->writeBack = level->writeBack;
+		level->cache->writeAllocate = level->writeAllocate;
+		level->pending = (unsigned long long*) malloc(HIERARCHY_BATCH * sizeof(unsigned long long));
+		level->pendingRequest = (unsigned char*) malloc(HIERARCHY_BATCH);
+		level->pendingSize = (unsigned int*) malloc(HIERARCHY_BATCH * sizeof(unsigned int));
+	}
+	return hier;
+}
+
+void finishHierarchy(cacheHierarchy* hier) {
+	for(int i = hier->numFirst; i < hier->numLevels; i++) { // top down, so each level's misses reach the next
+		runLevel(hier, i);
+	}
+	for(int i = 0; i < hier->numLevels; i++) {
+		cacheLevel* level = &hier->levels[i];
+		printLevelSummary(level->name, level->info.numHits, level->info.numMisses, level->info.numEvicts);
+		printTrafficSummary(level->name, level->info.numDirtyEvicts, level->info.bytesRead, level->info.bytesWritten);
+		if(level->backInvalidations > 0) {
+			printf("%s back-invalidations:%llu\n", level->name, level->backInvalidations);
+		}
+	}
+}
+
+void cleanHierarchy(cacheHierarchy* hier) {
+	for(int i = 0; i < hier->numLevels; i++) {
+		cleanCache(hier->levels[i].cache, hier->levels[i].info);
+		free(hier->levels[i].pending);
+		free(hier->levels[i].pendingRequest);
+		free(hier->levels[i].pendingSize);
+	}
+	free(hier);
+}
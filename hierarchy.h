@@ -0,0 +1,72 @@
+/*
+ * hierarchy.h - Multi-level cache hierarchies for csim
+ *
+ * A hierarchy is described one level per line (or per ';'), top down:
+ *
+ *   # name  s   E   b   [policy]  [inclusion]  [write policy]
+ *   L1I     6   8   6   lru
+ *   L1D     6   8   6   lru                    wt nwa
+ *   L2      9   8   6   lru       nine
+ *   LLC     11  16  6   srrip     inclusive    wb
+ *
+ * The first level is either a unified L1 or an L1I/L1D pair; I records go
+ * to L1I and are ignored without one. Every later level sits below the one
+ * before it. Inclusion says how a level relates to everything above it:
+ * "nine" (the default) fills on every miss and never reaches upward,
+ * "inclusive" also drops its victims from the levels above, and
+ * "exclusive" only holds blocks evicted from the level above and gives a
+ * block up when the level above takes it. Write policies are as for -w:
+ * wb or wt, and wa or nwa, defaulting to write-back and write-allocate.
+ */
+#ifndef CACHELAB_HIERARCHY_H
+#define CACHELAB_HIERARCHY_H
+
+#include "cache.h"
+#include "trace.h"
+
+#define MAX_LEVELS 8
+#define HIERARCHY_BATCH 256 /* requests queued for a level before it runs */
+
+typedef enum inclusion {
+	INCLUSION_NINE, // neither inclusive nor exclusive
+	INCLUSION_INCLUSIVE, // everything above is also here
+	INCLUSION_EXCLUSIVE // nothing above is also here
+} inclusionPolicy;
+
+typedef struct level {
+	char name[16]; // what the level is called in the description and the summary
+	cacheInfo info; // its geometry and counters
+	Cache* cache; // its lines
+	replacementPolicy policy; // how it picks victims
+	inclusionPolicy inclusion; // how it relates to the levels above
+	int writeBack; // write-back (1) or write-through (0)
+	int writeAllocate; // write-allocate (1) or no-write-allocate (0)
+	unsigned long long backInvalidations; // lines dropped from the levels above to keep this level inclusive
+	unsigned long long* pending; // requests from the level above waiting to run here
+	unsigned char* pendingRequest; // what each one is (REQUEST_READ, REQUEST_WRITEBACK, ...)
+	unsigned int* pendingSize; // the bytes each one carries
+	int numPending; // requests queued
+	int batch; // how many requests to queue before running them
+} cacheLevel;
+
+typedef struct hierarchy {
+	cacheLevel levels[MAX_LEVELS]; // top down
+	int numLevels;
+	int numFirst; // how many first level caches there are (1 or 2)
+	int instIndex; // the level that takes I records, or -1
+	int dataIndex; // the level that takes L, S and M records
+} cacheHierarchy;
+
+/* Build a hierarchy from a description file, or from the description itself. Returns NULL on error. */
+cacheHierarchy* newHierarchy(const char* spec);
+
+/* The recordSink for -H: send each record through the first level */
+void hierarchyRecords(void* state, const traceRecord* recs, unsigned int count);
+
+/* Run everything still queued and print each level's summary */
+void finishHierarchy(cacheHierarchy* hier);
+
+/* Free the hierarchy */
+void cleanHierarchy(cacheHierarchy* hier);
+
+#endif /* CACHELAB_HIERARCHY_H */
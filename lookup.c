@@ -0,0 +1,162 @@
+/*
+ * lookup.c - Scalar, SSE4.1 and AVX2 searches over one cache set
+ *
+ * Each search returns the first matching line, or -1 if there isn't one.
+ * The vector versions are compiled with per-function target attributes so
+ * the rest of the program doesn't need -mavx2, and are only called after
+ * checking the CPU at runtime.
+ */
+#include "lookup.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+static int scalarFindHit(const unsigned long long* tags, const unsigned char* valid, int ways, unsigned long long tag) {
+	for(int i = 0; i < ways; i++) {
+		if(valid[i] && tags[i] == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int scalarFindHit32(const unsigned int* tags, const unsigned char* valid, int ways, unsigned int tag) {
+	for(int i = 0; i < ways; i++) {
+		if(valid[i] && tags[i] == tag) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int scalarFindEmpty(const unsigned char* valid, int ways) {
+	for(int i = 0; i < ways; i++) {
+		if(!valid[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * Eight valid bytes at a time; this is plain SSE2 so both vector levels share it
+ */
+static int vectorFindEmpty(const unsigned char* valid, int ways) {
+	const __m128i zero = _mm_setzero_si128();
+	for(int i = 0; i < ways; i += 8) {
+		__m128i v = _mm_loadl_epi64((const __m128i*) (valid + i));
+		int empty = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xff;
+		if(empty) {
+			return i + __builtin_ctz(empty);
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("sse4.1")))
+static int sse4FindHit(const unsigned long long* tags, const unsigned char* valid, int ways, unsigned long long tag) {
+	const __m128i key = _mm_set1_epi64x(tag);
+	for(int i = 0; i < ways; i += 2) {
+		__m128i t = _mm_load_si128((const __m128i*) (tags + i));
+		int match = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(t, key)));
+		while(match) { // a tag can still match a line that was never filled
+			int j = __builtin_ctz(match);
+			if(valid[i + j]) {
+				return i + j;
+			}
+			match &= match - 1;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Four packed tags at a time, which only needs SSE2 but goes with the SSE4.1 kernels
+ */
+static int sse4FindHit32(const unsigned int* tags, const unsigned char* valid, int ways, unsigned int tag) {
+	const __m128i key = _mm_set1_epi32((int) tag);
+	for(int i = 0; i < ways; i += 4) {
+		__m128i t = _mm_load_si128((const __m128i*) (tags + i));
+		int match = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(t, key)));
+		while(match) {
+			int j = __builtin_ctz(match);
+			if(valid[i + j]) {
+				return i + j;
+			}
+			match &= match - 1;
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("avx2")))
+static int avx2FindHit(const unsigned long long* tags, const unsigned char* valid, int ways, unsigned long long tag) {
+	const __m256i key = _mm256_set1_epi64x(tag);
+	for(int i = 0; i < ways; i += 8) {
+		__m256i lo = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i*) (tags + i)), key);
+		__m256i hi = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i*) (tags + i + 4)), key);
+		int match = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+		while(match) { // a tag can still match a line that was never filled
+			int j = __builtin_ctz(match);
+			if(valid[i + j]) {
+				return i + j;
+			}
+			match &= match - 1;
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("avx2")))
+static int avx2FindHit32(const unsigned int* tags, const unsigned char* valid, int ways, unsigned int tag) {
+	const __m256i key = _mm256_set1_epi32((int) tag);
+	for(int i = 0; i < ways; i += 8) {
+		__m256i t = _mm256_load_si256((const __m256i*) (tags + i));
+		int match = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, key)));
+		while(match) {
+			int j = __builtin_ctz(match);
+			if(valid[i + j]) {
+				return i + j;
+			}
+			match &= match - 1;
+		}
+	}
+	return -1;
+}
+
+#endif /* HAVE_X86_SIMD */
+
+lookupOps chooseLookup(int E) {
+	lookupOps ops = { "scalar", scalarFindHit, scalarFindHit32, scalarFindEmpty };
+	const char* want = getenv("CSIM_SIMD");
+
+	if(E < LOOKUP_WIDTH || (want && strcmp(want, "scalar") == 0)) { // small sets aren't worth a vector
+		return ops;
+	}
+
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	int avx2 = __builtin_cpu_supports("avx2") && (!want || strcmp(want, "avx2") == 0);
+	int sse4 = __builtin_cpu_supports("sse4.1") && (!want || strcmp(want, "sse4") == 0 || strcmp(want, "avx2") == 0);
+
+	if(avx2) {
+		ops.name = "avx2";
+		ops.findHit = avx2FindHit;
+		ops.findHit32 = avx2FindHit32;
+		ops.findEmpty = vectorFindEmpty;
+	}
+	else if(sse4) {
+		ops.name = "sse4";
+		ops.findHit = sse4FindHit;
+		ops.findHit32 = sse4FindHit32;
+		ops.findEmpty = vectorFindEmpty;
+	}
+#endif
+	return ops;
+}
@@ -0,0 +1,28 @@
+/*
+ * lookup.h - Searches over one set of the structure-of-arrays cache
+ *
+ * Each set stores its tags and valid bytes in separate arrays of
+ * "ways" entries. Tags are 64 bits, or 32 while the cache packs them (see
+ * cache.h), with a search for each. When vector kernels are in use, ways is the
+ * associativity rounded up to a multiple of LOOKUP_WIDTH, and the padding
+ * lanes are never valid.
+ */
+#ifndef CACHELAB_LOOKUP_H
+#define CACHELAB_LOOKUP_H
+
+#define LOOKUP_WIDTH 8 /* sets of at least this many lines use the vector kernels */
+
+typedef struct lookup {
+	const char* name; // which instruction set the kernels use
+	int (*findHit)(const unsigned long long* tags, const unsigned char* valid, int ways, unsigned long long tag);
+	int (*findHit32)(const unsigned int* tags, const unsigned char* valid, int ways, unsigned int tag);
+	int (*findEmpty)(const unsigned char* valid, int ways);
+} lookupOps;
+
+/*
+ * chooseLookup - Pick the fastest kernels this CPU supports for sets of E lines.
+ *     Setting CSIM_SIMD to "scalar", "sse4" or "avx2" overrides the choice.
+ */
+lookupOps chooseLookup(int E);
+
+#endif /* CACHELAB_LOOKUP_H */
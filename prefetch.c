@@ -0,0 +1,233 @@
+/*
+ * prefetch.c - Next-line, adjacent-line and stride prefetchers
+ *
+ * Prefetched lines carry LINE_PREFETCHED until a demand access uses them,
+ * and the engine reports ACCESS_UNUSED when one is evicted first. The
+ * in-flight and victim tables are direct mapped, so a collision can forget
+ * a late prefetch or a polluting one, but never invents one.
+ */
+#include "prefetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* prefetcherNames[NUM_PREFETCHERS] = { "next", "adjacent", "stride" };
+
+static size_t slotOf(unsigned long long block) {
+	return ((block * 0x9e3779b97f4a7c15ULL) >> 32) & (PREFETCH_SLOTS - 1);
+}
+
+prefetcher* newPrefetcher(const char* spec) {
+	char name[32];
+	size_t length = strcspn(spec, ":");
+	if(length >= sizeof(name)) {
+		length = sizeof(name) - 1;
+	}
+	memcpy(name, spec, length);
+	name[length] = '\0';
+
+	int kind = -1;
+	for(int i = 0; i < NUM_PREFETCHERS; i++) {
+		if(strcmp(name, prefetcherNames[i]) == 0) {
+			kind = i;
+		}
+	}
+	if(kind < 0) {
+		printf("Unknown prefetcher %s.\n", name);
+		return NULL;
+	}
+
+	prefetcher* pf = (prefetcher*) calloc(1, sizeof(prefetcher));
+	if(pf == NULL) {
+		return NULL;
+	}
+	pf->kind = kind;
+	pf->degree = 1;
+	pf->distance = 1;
+	pf->numStreams = 16;
+	pf->latency = 0;
+
+	const char* knob = spec[length] == ':' ? spec + length + 1 : NULL;
+	while(knob != NULL && *knob != '\0') {
+		char key[16];
+		int value, used;
+		if(sscanf(knob, "%15[a-z]=%d%n", key, &value, &used) != 2) {
+			printf("Can't read the prefetcher setting at %s.\n", knob);
+			free(pf);
+			return NULL;
+		}
+		if(strcmp(key, "degree") == 0 && value >= 1 && value <= 64) {
+			pf->degree = value;
+		}
+		else if(strcmp(key, "distance") == 0 && value >= 1) {
+			pf->distance = value;
+		}
+		else if(strcmp(key, "streams") == 0 && value >= 1 && value <= MAX_STREAMS) {
+			pf->numStreams = value;
+		}
+		else if(strcmp(key, "latency") == 0 && value >= 0) {
+			pf->latency = value;
+		}
+		else {
+			printf("Invalid prefetcher setting %s=%d.\n", key, value);
+			free(pf);
+			return NULL;
+		}
+		knob += used;
+		if(*knob == ',') {
+			knob++;
+		}
+	}
+
+	if(pf->kind == PREFETCH_STRIDE) {
+		pf->streams = (streamEntry*) calloc(pf->numStreams, sizeof(streamEntry));
+	}
+	return pf;
+}
+
+/*
+ * Fill one block if it isn't cached already
+ */
+static void issue(prefetcher* pf, Cache* cache, cacheInfo* info, unsigned long long block) {
+	unsigned long long address = block << info->b, evicted;
+	int result = accessCache(cache, info, address, REQUEST_PREFETCH, info->B, 0, &evicted);
+	if(!(result & ACCESS_MISS)) {
+		return;
+	}
+
+	pf->issued++;
+	if(result & ACCESS_UNUSED) {
+		pf->unused++;
+	}
+	if(result & ACCESS_EVICT) {
+		unsigned long long victim = evicted >> info->b;
+		pf->victims[slotOf(victim)] = victim + 1;
+	}
+	*lineState(cache, *info, address) |= LINE_PREFETCHED;
+	prefetchSlot* slot = &pf->inFlight[slotOf(block)];
+	slot->key = block + 1;
+	slot->time = pf->now + pf->latency;
+}
+
+/*
+ * The stream an access to block belongs to, replacing the least recently
+ * used one if none is close enough. Sets *fresh for a new stream.
+ */
+static streamEntry* findStream(prefetcher* pf, unsigned long long block, int* fresh) {
+	streamEntry* oldest = NULL;
+	for(int i = 0; i < pf->usedStreams; i++) {
+		streamEntry* stream = &pf->streams[i];
+		unsigned long long gap = block > stream->lastBlock ? block - stream->lastBlock : stream->lastBlock - block;
+		if(gap <= STREAM_WINDOW) {
+			*fresh = 0;
+			return stream;
+		}
+		if(oldest == NULL || stream->lastUse < oldest->lastUse) {
+			oldest = stream;
+		}
+	}
+	if(pf->usedStreams < pf->numStreams) {
+		oldest = &pf->streams[pf->usedStreams++];
+	}
+	memset(oldest, 0, sizeof(streamEntry));
+	*fresh = 1;
+	return oldest;
+}
+
+static void strideAccess(prefetcher* pf, Cache* cache, cacheInfo* info, unsigned long long block) {
+	int fresh;
+	streamEntry* stream = findStream(pf, block, &fresh);
+	long long delta = (long long) (block - stream->lastBlock);
+
+	stream->lastUse = pf->now;
+	if(fresh) {
+		stream->lastBlock = block;
+		return;
+	}
+	if(delta == 0) { // still in the same block
+		return;
+	}
+	if(delta == stream->stride) {
+		if(stream->confidence < 3) {
+			stream->confidence++;
+		}
+	}
+	else {
+		stream->stride = delta;
+		stream->confidence = 0;
+	}
+	stream->lastBlock = block;
+
+	if(stream->confidence >= 1) {
+		for(int i = 0; i < pf->degree; i++) {
+			long long target = (long long) block + stream->stride * (pf->distance + i);
+			if(target >= 0) {
+				issue(pf, cache, info, (unsigned long long) target);
+			}
+		}
+	}
+}
+
+void prefetchAccess(prefetcher* pf, Cache* cache, cacheInfo* info, unsigned long long address, int request, int result) {
+	if(request != REQUEST_READ && request != REQUEST_WRITE) {
+		return;
+	}
+
+	unsigned long long block = address >> info->b;
+	int trigger = 0;
+	pf->now++;
+	if(result & ACCESS_UNUSED) {
+		pf->unused++;
+	}
+	if(result & ACCESS_MISS) {
+		unsigned long long* victim = &pf->victims[slotOf(block)];
+		if(*victim == block + 1) {
+			pf->polluting++;
+			*victim = 0;
+		}
+		trigger = 1;
+	}
+	else {
+		unsigned char* state = lineState(cache, *info, address);
+		if(state != NULL && (*state & LINE_PREFETCHED)) { // the first use of a prefetched line
+			*state &= ~LINE_PREFETCHED;
+			prefetchSlot* slot = &pf->inFlight[slotOf(block)];
+			if(slot->key == block + 1 && pf->now <= slot->time) {
+				pf->late++;
+			}
+			else {
+				pf->useful++;
+			}
+			trigger = 1;
+		}
+	}
+
+	switch(pf->kind) {
+	case PREFETCH_NEXT:
+		if(trigger) {
+			for(int i = 0; i < pf->degree; i++) {
+				issue(pf, cache, info, block + pf->distance + i);
+			}
+		}
+		break;
+	case PREFETCH_ADJACENT:
+		if(result & ACCESS_MISS) {
+			issue(pf, cache, info, block ^ 1);
+		}
+		break;
+	default:
+		strideAccess(pf, cache, info, block);
+		break;
+	}
+}
+
+void printPrefetchSummary(prefetcher* pf, const char* level) {
+	printf("%s%sprefetches:%llu useful:%llu late:%llu unused:%llu polluting:%llu\n",
+			level != NULL ? level : "", level != NULL ? " " : "",
+			pf->issued, pf->useful, pf->late, pf->unused, pf->polluting);
+}
+
+void cleanPrefetcher(prefetcher* pf) {
+	free(pf->streams);
+	free(pf);
+}
@@ -0,0 +1,83 @@
+/*
+ * prefetch.h - Hardware prefetcher models for csim -F
+ *
+ * A prefetcher watches the demand accesses to a cache and fills the blocks
+ * it predicts with REQUEST_PREFETCH, which reads them from the next level
+ * without counting a hit or a miss. It's described as a kind with optional
+ * knobs, e.g. "next", "stride:degree=4,distance=2,streams=8":
+ *
+ *   next      on a miss, or a first use of a prefetched line, fetch the
+ *             degree blocks starting distance blocks ahead
+ *   adjacent  on a miss, fetch the other block of the aligned pair
+ *   stride    track up to streams access streams without instruction
+ *             addresses; once two strides in a row match, fetch degree
+ *             blocks starting distance strides ahead on every access to it
+ *
+ * A prefetch is useful when a demand access hits its line before it's
+ * evicted, and late when that happens before latency (default 0) demand
+ * accesses have gone by since it was issued. A prefetched line evicted
+ * before any use is unused, and a demand miss on a block a prefetch pushed
+ * out is polluting.
+ */
+#ifndef CACHELAB_PREFETCH_H
+#define CACHELAB_PREFETCH_H
+
+#include "cache.h"
+
+#define PREFETCH_SLOTS 4096 /* in-flight prefetches and prefetch victims remembered (a power of 2) */
+#define STREAM_WINDOW 64 /* blocks from its last access an access can be and still join a stream */
+#define MAX_STREAMS 256
+
+typedef enum prefetcherKind {
+	PREFETCH_NEXT, // next-line
+	PREFETCH_ADJACENT, // adjacent-line
+	PREFETCH_STRIDE, // stride/stream detection
+	NUM_PREFETCHERS
+} prefetcherKind;
+
+typedef struct stream {
+	unsigned long long lastBlock; // the block the stream last touched
+	long long stride; // in blocks
+	int confidence; // times in a row the stride repeated
+	unsigned long long lastUse; // demand access count when it was last touched, for LRU
+} streamEntry;
+
+typedef struct slot {
+	unsigned long long key; // block number + 1, or 0 for an empty slot
+	unsigned long long time; // when the prefetch is ready (inFlight) or unused
+} prefetchSlot;
+
+typedef struct prefetcher {
+	prefetcherKind kind;
+	int degree; // blocks fetched per trigger
+	int distance; // how far ahead the first one is
+	int numStreams; // streams the stride prefetcher tracks
+	int latency; // demand accesses before a prefetch arrives
+	streamEntry* streams;
+	int usedStreams;
+	unsigned long long now; // demand accesses so far
+	prefetchSlot inFlight[PREFETCH_SLOTS]; // recent prefetches and when they arrive
+	unsigned long long victims[PREFETCH_SLOTS]; // blocks prefetches evicted (block + 1, or 0)
+	unsigned long long issued; // prefetches that filled a line
+	unsigned long long useful; // prefetched lines a demand access used in time
+	unsigned long long late; // prefetched lines a demand access used before they arrived
+	unsigned long long unused; // prefetched lines evicted before any use
+	unsigned long long polluting; // demand misses on blocks a prefetch evicted
+} prefetcher;
+
+/* A prefetcher from a description like "stride:degree=2", or NULL after printing why not */
+prefetcher* newPrefetcher(const char* spec);
+
+/*
+ * prefetchAccess - Account for one demand request to cache, which returned
+ *     result, and issue the prefetches it triggers
+ */
+void prefetchAccess(prefetcher* pf, Cache* cache, cacheInfo* info, unsigned long long address, int request, int result);
+
+/* Print the prefetch counters, prefixed by level unless it's NULL */
+void printPrefetchSummary(prefetcher* pf, const char* level);
+
+/* Free the prefetcher */
+void cleanPrefetcher(prefetcher* pf);
+
+#endif /* CACHELAB_PREFETCH_H */
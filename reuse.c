@@ -0,0 +1,185 @@
+/*
+ * reuse.c - Exact reuse distances with a Fenwick tree
+ */
+#include "reuse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_TIMES (1 << 16) // times the tree covers before its first renumbering
+
+static size_t hashBlock(unsigned long long block, size_t capacity) {
+	return ((block * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity - 1);
+}
+
+/*
+ * Fenwick tree helpers. Time t is position t + 1.
+ */
+static void treeAdd(reuseProfile* profile, size_t time, int delta) {
+	for(size_t i = time + 1; i <= profile->treeSize; i += i & -i) {
+		profile->tree[i - 1] += delta;
+	}
+}
+
+static size_t treeCount(reuseProfile* profile, size_t end) { // marks at times before end
+	size_t sum = 0;
+	for(size_t i = end; i > 0; i -= i & -i) {
+		sum += profile->tree[i - 1];
+	}
+	return sum;
+}
+
+reuseProfile* newReuseProfile(int b) {
+	reuseProfile* profile = (reuseProfile*) calloc(1, sizeof(reuseProfile));
+	if(profile == NULL) {
+		return NULL;
+	}
+	profile->b = b;
+	profile->treeSize = INITIAL_TIMES;
+	profile->tree = (unsigned int*) calloc(profile->treeSize, sizeof(unsigned int));
+	profile->blockCapacity = 1024;
+	profile->blocks = (lastUse*) calloc(profile->blockCapacity, sizeof(lastUse));
+	profile->histogramSize = 1024;
+	profile->histogram = (unsigned long long*) calloc(profile->histogramSize, sizeof(unsigned long long));
+	if(profile->tree == NULL || profile->blocks == NULL || profile->histogram == NULL) {
+		printf("Couldn't allocate the reuse profile.\n");
+		cleanReuseProfile(profile);
+		return NULL;
+	}
+	return profile;
+}
+
+/*
+ * The last use of a block, adding it with no time yet if it's new (*added is then set)
+ */
+static lastUse* findBlock(reuseProfile* profile, unsigned long long block, int* added) {
+	unsigned long long key = block + 1;
+	size_t i = hashBlock(block, profile->blockCapacity);
+
+	*added = 0;
+	for(; profile->blocks[i].key != 0; i = (i + 1) & (profile->blockCapacity - 1)) {
+		if(profile->blocks[i].key == key) {
+			return &profile->blocks[i];
+		}
+	}
+
+	if(2 * (profile->numBlocks + 1) > profile->blockCapacity) { // keep the table at most half full
+		lastUse* old = profile->blocks;
+		size_t oldCapacity = profile->blockCapacity;
+		profile->blockCapacity *= 2;
+		profile->blocks = (lastUse*) calloc(profile->blockCapacity, sizeof(lastUse));
+		for(size_t j = 0; j < oldCapacity; j++) {
+			if(old[j].key != 0) {
+				size_t k = hashBlock(old[j].key - 1, profile->blockCapacity);
+				while(profile->blocks[k].key != 0) {
+					k = (k + 1) & (profile->blockCapacity - 1);
+				}
+				profile->blocks[k] = old[j];
+			}
+		}
+		free(old);
+		i = hashBlock(block, profile->blockCapacity);
+		while(profile->blocks[i].key != 0) {
+			i = (i + 1) & (profile->blockCapacity - 1);
+		}
+	}
+	profile->blocks[i].key = key;
+	profile->numBlocks++;
+	*added = 1;
+	return &profile->blocks[i];
+}
+
+static int compareTimes(const void* a, const void* b) {
+	size_t x = (*(const lastUse* const*) a)->time;
+	size_t y = (*(const lastUse* const*) b)->time;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Out of times: number the blocks' last uses 0, 1, 2... in the same order
+ * and rebuild the tree, at least twice as big as the number of blocks
+ */
+static void renumber(reuseProfile* profile) {
+	lastUse** order = (lastUse**) malloc((profile->numBlocks + 1) * sizeof(lastUse*));
+	size_t count = 0;
+	for(size_t i = 0; i < profile->blockCapacity; i++) {
+		if(profile->blocks[i].key != 0) {
+			order[count++] = &profile->blocks[i];
+		}
+	}
+	qsort(order, count, sizeof(lastUse*), compareTimes);
+	for(size_t i = 0; i < count; i++) {
+		order[i]->time = i;
+	}
+	free(order);
+
+	if(profile->treeSize < 2 * count) {
+		profile->treeSize = 2 * count;
+		free(profile->tree);
+		profile->tree = (unsigned int*) malloc(profile->treeSize * sizeof(unsigned int));
+	}
+	memset(profile->tree, 0, profile->treeSize * sizeof(unsigned int));
+	for(size_t i = 1; i <= profile->treeSize; i++) { // linear build: every time below count is marked
+		profile->tree[i - 1] += i <= count;
+		size_t parent = i + (i & -i);
+		if(parent <= profile->treeSize) {
+			profile->tree[parent - 1] += profile->tree[i - 1];
+		}
+	}
+	profile->now = count;
+}
+
+void reuseAccess(reuseProfile* profile, unsigned long long address) {
+	int added;
+
+	if(profile->now == profile->treeSize) {
+		renumber(profile);
+	}
+	lastUse* last = findBlock(profile, address >> profile->b, &added);
+	if(added) {
+		profile->cold++;
+	}
+	else {
+		size_t distance = treeCount(profile, profile->now) - treeCount(profile, last->time + 1);
+		if(distance >= profile->histogramSize) {
+			size_t oldSize = profile->histogramSize;
+			while(distance >= profile->histogramSize) {
+				profile->histogramSize *= 2;
+			}
+			profile->histogram = (unsigned long long*) realloc(profile->histogram, profile->histogramSize * sizeof(unsigned long long));
+			memset(profile->histogram + oldSize, 0, (profile->histogramSize - oldSize) * sizeof(unsigned long long));
+		}
+		profile->histogram[distance]++;
+		treeAdd(profile, last->time, -1);
+	}
+	treeAdd(profile, profile->now, 1);
+	last->time = profile->now++;
+	profile->accesses++;
+}
+
+void printReuseProfile(reuseProfile* profile) {
+	for(size_t d = 0; d < profile->histogramSize; d++) {
+		if(profile->histogram[d] != 0) {
+			printf("distance:%zu count:%llu\n", d, profile->histogram[d]);
+		}
+	}
+	printf("distance:inf count:%llu\n", profile->cold);
+
+	// a cache of d + 1 lines turns the accesses at distance d into hits
+	unsigned long long misses = profile->accesses;
+	for(size_t d = 0; d < profile->histogramSize; d++) {
+		if(profile->histogram[d] != 0) {
+			misses -= profile->histogram[d];
+			printf("lines:%zu bytes:%llu misses:%llu miss-ratio:%.6f\n", d + 1,
+					(unsigned long long) (d + 1) << profile->b, misses,
+					profile->accesses ? (double) misses / profile->accesses : 0.0);
+		}
+	}
+}
+
+void cleanReuseProfile(reuseProfile* profile) {
+	free(profile->tree);
+	free(profile->blocks);
+	free(profile->histogram);
+	free(profile);
+}
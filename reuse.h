@@ -0,0 +1,55 @@
+/*
+ * reuse.h - Reuse distance profiles for csim -r
+ *
+ * The reuse (stack) distance of an access is the number of distinct blocks
+ * touched since the last access to its block, or infinite on the first
+ * touch. A fully associative LRU cache of C lines hits exactly the accesses
+ * with a distance below C, so one histogram gives the miss ratio curve for
+ * every cache size.
+ *
+ * Each block's last access time is marked in a Fenwick tree over time, so
+ * the distinct blocks since then are a prefix sum away and every access is
+ * O(log n) in the number of distinct blocks. When the tree fills up the live
+ * marks are renumbered in order, so its size follows the number of distinct
+ * blocks rather than the length of the trace.
+ */
+#ifndef CACHELAB_REUSE_H
+#define CACHELAB_REUSE_H
+
+#include <stddef.h>
+
+typedef struct lastUse {
+	unsigned long long key; // block number + 1, or 0 for an empty slot
+	size_t time; // when the block was last accessed
+} lastUse;
+
+typedef struct reuse {
+	int b; // 2^b bytes per block
+	unsigned int* tree; // Fenwick tree over times: 1 where a block was last accessed
+	size_t treeSize; // times the tree covers
+	size_t now; // the time of the next access
+	lastUse* blocks; // open-addressed table of every block seen
+	size_t blockCapacity; // slots in blocks (a power of 2)
+	size_t numBlocks; // slots in use
+	unsigned long long* histogram; // histogram[d] = accesses at reuse distance d
+	size_t histogramSize; // entries allocated in histogram
+	unsigned long long cold; // first touches (infinite distance)
+	unsigned long long accesses; // every access seen
+} reuseProfile;
+
+/* An empty profile for 2^b byte blocks, or NULL if it can't be allocated */
+reuseProfile* newReuseProfile(int b);
+
+/* Add one access to the profile */
+void reuseAccess(reuseProfile* profile, unsigned long long address);
+
+/*
+ * printReuseProfile - Print the histogram, then the misses of a fully
+ *     associative LRU cache at each size where the curve steps down
+ */
+void printReuseProfile(reuseProfile* profile);
+
+/* Free the profile */
+void cleanReuseProfile(reuseProfile* profile);
+
+#endif /* CACHELAB_REUSE_H */
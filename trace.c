@@ -0,0 +1,323 @@
+/*
+ * trace.c - Text and binary memory trace readers and writers
+ */
+#define _DEFAULT_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static signed char hexValue[256]; // the value of each hex digit, or -1 for anything else
+static const char opChars[4] = { 'I', 'L', 'S', 'M' }; // the 2-bit op codes used by binary traces
+
+void initTraceParser() {
+	for(int i = 0; i < 256; i++) {
+		hexValue[i] = -1;
+	}
+	for(int i = 0; i < 10; i++) {
+		hexValue['0' + i] = i;
+	}
+	for(int i = 0; i < 6; i++) {
+		hexValue['a' + i] = 10 + i;
+		hexValue['A' + i] = 10 + i;
+	}
+}
+
+int parseTraceLine(const char** pos, const char* end, traceRecord* rec) {
+	const char* p = *pos;
+	int ok = 0;
+
+	while(p < end && (*p == ' ' || *p == '\t')) { p++; } // skip the leading space
+	if(p < end && *p != '\n') {
+		char op = *p++;
+		while(p < end && (*p == ' ' || *p == '\t')) { p++; }
+
+		unsigned long long addr = 0;
+		const char* digits = p;
+		while(p < end && hexValue[(unsigned char) *p] >= 0) { // hand-rolled hex scan, no sscanf
+			addr = (addr << 4) | hexValue[(unsigned char) *p];
+			p++;
+		}
+
+		if(p > digits && p < end && *p == ',') {
+			unsigned int size = 0;
+			p++;
+			while(p < end && *p >= '0' && *p <= '9') {
+				size = size * 10 + (*p - '0');
+				p++;
+			}
+			rec->op = op;
+			rec->address = addr;
+			rec->len = size;
+			ok = 1;
+		}
+	}
+
+	const char* nl = memchr(p, '\n', end - p); // lines can be any length, just skip whatever is left over
+	*pos = nl ? nl + 1 : end;
+	return ok;
+}
+
+/*
+ * Little endian helpers so the format doesn't depend on the host
+ */
+static void putU32(unsigned char* p, unsigned int v) {
+	for(int i = 0; i < 4; i++) { p[i] = v >> (8 * i); }
+}
+
+static void putU64(unsigned char* p, unsigned long long v) {
+	for(int i = 0; i < 8; i++) { p[i] = v >> (8 * i); }
+}
+
+static unsigned int getU32(const unsigned char* p) {
+	unsigned int v = 0;
+	for(int i = 3; i >= 0; i--) { v = (v << 8) | p[i]; }
+	return v;
+}
+
+static unsigned long long getU64(const unsigned char* p) {
+	unsigned long long v = 0;
+	for(int i = 7; i >= 0; i--) { v = (v << 8) | p[i]; }
+	return v;
+}
+
+static unsigned char* putVarint(unsigned char* p, unsigned long long v) {
+	while(v >= 0x80) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+/*
+ * Decode a varint that has to end before end. Returns NULL if it runs past
+ * end or is longer than any 64-bit value needs.
+ */
+static const unsigned char* getVarint(const unsigned char* p, const unsigned char* end, unsigned long long* v) {
+	unsigned long long result = 0;
+	int shift = 0;
+	while(p < end && (*p & 0x80)) {
+		if(shift > 63 - 7) { // the last byte of a 64-bit value can't have more coming
+			return NULL;
+		}
+		result |= (unsigned long long) (*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	if(p == end) {
+		return NULL;
+	}
+	*v = result | ((unsigned long long) *p++ << shift);
+	return p;
+}
+
+int openBinTrace(binTrace* trace, const char* file) {
+	struct stat st;
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) {
+		return -1;
+	}
+	if(fstat(fd, &st) != 0 || st.st_size < TRACE_HEADER_SIZE + TRACE_FOOTER_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if(map == MAP_FAILED) {
+		return -1;
+	}
+
+	const unsigned char* p = map;
+	const unsigned char* footer = p + st.st_size - TRACE_FOOTER_SIZE;
+	trace->map = p;
+	trace->size = st.st_size;
+	trace->blockRecords = getU32(p + 12);
+	trace->numBlocks = getU64(footer + 8);
+	trace->numRecords = getU64(footer + 16);
+	unsigned long long indexOffset = getU64(footer);
+
+	if(memcmp(p, TRACE_MAGIC, 8) != 0 || getU32(p + 8) != TRACE_VERSION ||
+			memcmp(footer + 24, TRACE_MAGIC, 8) != 0 || trace->blockRecords == 0 ||
+			indexOffset > st.st_size - TRACE_FOOTER_SIZE ||
+			trace->numBlocks > (st.st_size - TRACE_FOOTER_SIZE - indexOffset) / 16) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	trace->index = p + indexOffset;
+
+	// make sure every block fits in the file before anyone decodes it (readBinBlock keeps inside each one)
+	for(unsigned long long i = 0; i < trace->numBlocks; i++) {
+		unsigned long long offset = getU64(trace->index + 16 * i);
+		if(offset + TRACE_BLOCK_HEADER_SIZE > indexOffset ||
+				getU32(p + offset) > trace->blockRecords ||
+				offset + TRACE_BLOCK_HEADER_SIZE + getU32(p + offset + 4) > indexOffset) {
+			munmap(map, st.st_size);
+			return -1;
+		}
+	}
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+int readBinBlock(const binTrace* trace, unsigned long long block, traceRecord* out, unsigned int* count) {
+	const unsigned char* p = trace->map + getU64(trace->index + 16 * block);
+	const unsigned char* end = p + TRACE_BLOCK_HEADER_SIZE + getU32(p + 4); // openBinTrace checked this is in the file
+	unsigned long long address = 0;
+	*count = getU32(p);
+	p += TRACE_BLOCK_HEADER_SIZE;
+
+	for(unsigned int i = 0; i < *count; i++) {
+		if(p == end) {
+			return -1;
+		}
+		unsigned char head = *p++;
+		unsigned long long len = head >> 2;
+		unsigned long long delta;
+
+		if(len == 63 && ((p = getVarint(p, end, &len)) == NULL || len > UINT_MAX)) { // the size didn't fit in the op byte
+			return -1;
+		}
+		if((p = getVarint(p, end, &delta)) == NULL) {
+			return -1;
+		}
+		address += (delta >> 1) ^ -(delta & 1); // undo the zigzag encoding
+
+		out[i].op = opChars[head & 3];
+		out[i].len = len;
+		out[i].address = address;
+	}
+	return 0;
+}
+
+unsigned long long findBinBlock(const binTrace* trace, unsigned long long first, unsigned long long* start) {
+	unsigned long long lo = 0, hi = trace->numBlocks; // the block is the last one starting at or before first
+	*start = trace->numRecords;
+	if(first >= trace->numRecords) {
+		return trace->numBlocks;
+	}
+	while(hi - lo > 1) {
+		unsigned long long mid = lo + (hi - lo) / 2;
+		if(getU64(trace->index + 16 * mid + 8) <= first) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	*start = getU64(trace->index + 16 * lo + 8);
+	return lo;
+}
+
+void closeBinTrace(binTrace* trace) {
+	munmap((void*) trace->map, trace->size);
+	trace->map = NULL;
+}
+
+binTraceWriter* newTraceWriter(FILE* fp, unsigned int blockRecords) {
+	binTraceWriter* writer = (binTraceWriter*) calloc(1, sizeof(binTraceWriter));
+	unsigned char header[TRACE_HEADER_SIZE];
+
+	writer->fp = fp;
+	writer->blockRecords = blockRecords ? blockRecords : TRACE_BLOCK_RECORDS;
+	writer->payload = (unsigned char*) malloc((size_t) writer->blockRecords * TRACE_MAX_RECORD_SIZE);
+	writer->capBlocks = 64;
+	writer->index = (unsigned long long*) malloc(writer->capBlocks * 2 * sizeof(unsigned long long));
+
+	memcpy(header, TRACE_MAGIC, 8);
+	putU32(header + 8, TRACE_VERSION);
+	putU32(header + 12, writer->blockRecords);
+	fwrite(header, 1, TRACE_HEADER_SIZE, fp);
+	writer->offset = TRACE_HEADER_SIZE;
+	return writer;
+}
+
+/*
+ * Write out the block we've been filling and remember where it went
+ */
+static void flushBlock(binTraceWriter* writer) {
+	unsigned char header[TRACE_BLOCK_HEADER_SIZE];
+
+	if(writer->count == 0) {
+		return;
+	}
+	if(writer->numBlocks == writer->capBlocks) {
+		writer->capBlocks *= 2;
+		writer->index = (unsigned long long*) realloc(writer->index, writer->capBlocks * 2 * sizeof(unsigned long long));
+	}
+	writer->index[2 * writer->numBlocks] = writer->offset;
+	writer->index[2 * writer->numBlocks + 1] = writer->numRecords - writer->count;
+	writer->numBlocks++;
+
+	putU32(header, writer->count);
+	putU32(header + 4, writer->used);
+	fwrite(header, 1, TRACE_BLOCK_HEADER_SIZE, writer->fp);
+	fwrite(writer->payload, 1, writer->used, writer->fp);
+	writer->offset += TRACE_BLOCK_HEADER_SIZE + writer->used;
+
+	writer->count = 0;
+	writer->used = 0;
+	writer->prev = 0; // each block starts over so it can be decoded on its own
+}
+
+void writeTraceRecord(binTraceWriter* writer, const traceRecord* rec) {
+	unsigned char* p = writer->payload + writer->used;
+	unsigned int op;
+	long long delta = (long long) (rec->address - writer->prev);
+
+	switch(rec->op) {
+	case 'L': op = 1; break;
+	case 'S': op = 2; break;
+	case 'M': op = 3; break;
+	default: op = 0; break;
+	}
+
+	if(rec->len < 63) {
+		*p++ = op | (rec->len << 2);
+	}
+	else {
+		*p++ = op | (63 << 2);
+		p = putVarint(p, rec->len);
+	}
+	p = putVarint(p, ((unsigned long long) delta << 1) ^ (unsigned long long) (delta >> 63)); // zigzag so small negative steps stay short
+
+	writer->used = p - writer->payload;
+	writer->prev = rec->address;
+	writer->count++;
+	writer->numRecords++;
+	if(writer->count == writer->blockRecords) {
+		flushBlock(writer);
+	}
+}
+
+int closeTraceWriter(binTraceWriter* writer) {
+	unsigned char buf[16];
+	unsigned long long indexOffset;
+	int ok;
+
+	flushBlock(writer);
+	indexOffset = writer->offset;
+	for(unsigned long long i = 0; i < writer->numBlocks; i++) {
+		putU64(buf, writer->index[2 * i]);
+		putU64(buf + 8, writer->index[2 * i + 1]);
+		fwrite(buf, 1, 16, writer->fp);
+	}
+
+	unsigned char footer[TRACE_FOOTER_SIZE];
+	putU64(footer, indexOffset);
+	putU64(footer + 8, writer->numBlocks);
+	putU64(footer + 16, writer->numRecords);
+	memcpy(footer + 24, TRACE_MAGIC, 8);
+	fwrite(footer, 1, TRACE_FOOTER_SIZE, writer->fp);
+
+	ok = fflush(writer->fp) == 0 && !ferror(writer->fp);
+	free(writer->payload);
+	free(writer->index);
+	free(writer);
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,100 @@
+/*
+ * trace.h - Reading and writing memory traces
+ *
+ * Text traces are the valgrind lackey format (" L 10,4"). Binary traces
+ * pack the same records into independently decodable blocks:
+ *
+ *   header:  "CLTRACE1", u32 version, u32 records per block
+ *   block:   u32 record count, u32 payload bytes, payload
+ *   record:  one byte with the op in bits 0-1 and the size in bits 2-7
+ *            (63 means a varint size follows), then the zigzag varint
+ *            delta of the address from the previous record in the block
+ *   index:   u64 file offset and u64 first record number of each block
+ *   footer:  u64 index offset, u64 blocks, u64 records, "CLTRACE1"
+ *
+ * All integers are little endian. The header is written first and the
+ * index last so the writer can stream to a pipe.
+ */
+#ifndef CACHELAB_TRACE_H
+#define CACHELAB_TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC "CLTRACE1"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK_RECORDS 4096 /* default records per block */
+#define TRACE_HEADER_SIZE 16
+#define TRACE_FOOTER_SIZE 32
+#define TRACE_BLOCK_HEADER_SIZE 8
+#define TRACE_MAX_RECORD_SIZE 21 /* op byte + varint size + varint delta */
+
+typedef struct record {
+	unsigned long long address; // the address of the access
+	unsigned int len; // the number of bytes accessed
+	char op; // I, L, S or M
+} traceRecord;
+
+typedef struct binTrace {
+	const unsigned char* map; // the whole file, mapped read only
+	size_t size; // bytes in the file
+	const unsigned char* index; // the block index near the end of the file
+	unsigned int blockRecords; // the most records any one block holds
+	unsigned long long numBlocks; // the number of blocks in the file
+	unsigned long long numRecords; // the number of records in the file
+} binTrace;
+
+typedef struct binTraceWriter {
+	FILE* fp; // where the trace is going
+	unsigned long long offset; // bytes written so far
+	unsigned int blockRecords; // records per block
+	unsigned int count; // records in the current block
+	unsigned long long prev; // the previous address in the current block
+	unsigned char* payload; // the encoded records of the current block
+	size_t used; // bytes of payload in use
+	unsigned long long* index; // offset and first record of every finished block
+	unsigned long long numBlocks; // blocks written so far
+	unsigned long long capBlocks; // room in index
+	unsigned long long numRecords; // records written so far
+} binTraceWriter;
+
+/* Set up the lookup tables used by parseTraceLine */
+void initTraceParser();
+
+/*
+ * parseTraceLine - Parse the text record starting at *pos in place.
+ *     Returns 1 if the line held an access and 0 if it should be skipped.
+ *     Either way *pos is left at the start of the next line.
+ */
+int parseTraceLine(const char** pos, const char* end, traceRecord* rec);
+
+/* Map a binary trace and check its header, footer and index. Returns 0 on success. */
+int openBinTrace(binTrace* trace, const char* file);
+
+/*
+ * readBinBlock - Decode one block into out (room for blockRecords) and put
+ *     the number of records in *count. Returns -1 if the block is corrupt:
+ *     a record runs past the end of its payload or its size doesn't fit.
+ */
+int readBinBlock(const binTrace* trace, unsigned long long block, traceRecord* out, unsigned int* count);
+
+/*
+ * findBinBlock - The block holding the record numbered first (from 0), or
+ *     numBlocks if the trace is shorter than that. *start is the number of
+ *     that block's first record.
+ */
+unsigned long long findBinBlock(const binTrace* trace, unsigned long long first, unsigned long long* start);
+
+/* Unmap a binary trace */
+void closeBinTrace(binTrace* trace);
+
+/* Start a binary trace on fp with the given number of records per block */
+binTraceWriter* newTraceWriter(FILE* fp, unsigned int blockRecords);
+
+/* Append one record */
+void writeTraceRecord(binTraceWriter* writer, const traceRecord* rec);
+
+/* Flush the last block, write the index and footer, and free the writer (fp stays open) */
+int closeTraceWriter(binTraceWriter* writer);
+
+#endif /* CACHELAB_TRACE_H */
@@ -0,0 +1,14 @@
+/*
+ * tracecall.c - The call into a transpose function, between the markers
+ *
+ * This is the only code outside trans.c whose accesses are traced, so the
+ * test-trans build compiles it with the same instrumentation as trans.c.
+ */
+#include "transtrace.h"
+
+void runTraced(int fn)
+{
+    traced.markerStart = 33;
+    (*traced.funcs[fn].func_ptr)(traced.M, traced.N, traced.A, traced.B);
+    traced.markerEnd = 34;
+}
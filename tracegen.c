@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include "cachelab.h"
+#include "transtrace.h"
 #include <string.h>
 
 /* External variables declared in cachelab.c */
@@ -22,32 +23,12 @@ extern int func_counter;
 /* External function from trans.c */
 extern void registerFunctions();
 
-/* Markers used to bound trace regions of interest */
-volatile char MARKER_START, MARKER_END;
-
-static int A[256][256];
-static int B[256][256];
-static int M;
-static int N;
-
-
-int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
-    for(int i=0;i<M;i++) {
-        for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
-                return 0;
-            }
-        }
-    }
-    return 1;
-}
+/* The matrices, dimensions and markers bounding the trace regions of
+   interest all live in "traced" (see transtrace.h) */
 
 int main(int argc, char* argv[]){
     int i;
+    int M = 0, N = 0;
 
     char c;
     int selectedFunc=-1;
@@ -74,34 +55,28 @@ int main(int argc, char* argv[]){
     registerFunctions();
 
     /* Fill A with data */
-    initMatrix(M,N, A, B); 
+    initTraced(M, N);
 
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
     assert(marker_fp);
     fprintf(marker_fp, "%llx %llx", 
-            (unsigned long long int) &MARKER_START,
-            (unsigned long long int) &MARKER_END );
+            (unsigned long long int) &traced.markerStart,
+            (unsigned long long int) &traced.markerEnd );
     fclose(marker_fp);
 
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            runTraced(i);
+            if (!validateTraced(i))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        runTraced(selectedFunc);
+        if (!validateTraced(selectedFunc))
             return selectedFunc+1;
 
     }
     return 0;
 }
-
-
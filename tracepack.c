@@ -0,0 +1,166 @@
+/*
+ * tracepack.c - Convert valgrind text traces to the binary format in
+ * trace.h, or (with -d) a binary trace back to text.
+ *
+ *   linux> ./tracepack -i traces/long.trace -o long.btrace
+ *   linux> ./csim -s 5 -E 1 -b 5 -T long.btrace
+ */
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#define READ_CHUNK (1 << 20) // bytes of text read at a time
+
+void usage(char* argv[]) {
+	printf("Usage: %s [-hd] [-B <records>] -i <infile> -o <outfile>\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h            Print this help message.\n");
+	printf("  -d            Decode a binary trace back to text.\n");
+	printf("  -B <records>  Records per block (default %d).\n", TRACE_BLOCK_RECORDS);
+	printf("  -i <infile>   Trace to read (\"-\" for stdin when encoding).\n");
+	printf("  -o <outfile>  Trace to write (\"-\" for stdout).\n");
+}
+
+/*
+ * Parse a text trace in chunks and append every record to the writer
+ */
+int encode(FILE* in, FILE* out, unsigned int blockRecords) {
+	size_t cap = READ_CHUNK;
+	size_t have = 0;
+	char* buf = (char*) malloc(cap);
+	binTraceWriter* writer = newTraceWriter(out, blockRecords);
+	traceRecord rec;
+	size_t got;
+	int done = 0;
+
+	initTraceParser();
+	while(!done) {
+		got = fread(buf + have, 1, cap - have, in);
+		have += got;
+		done = got == 0;
+
+		const char* pos = buf;
+		const char* end = buf + have;
+		if(!done) { // leave a partial last line for the next read
+			while(end > buf && end[-1] != '\n') { end--; }
+		}
+		while(pos < end) {
+			if(parseTraceLine(&pos, end, &rec)) {
+				writeTraceRecord(writer, &rec);
+			}
+		}
+
+		size_t used = pos - buf;
+		memmove(buf, pos, have - used);
+		have -= used;
+		if(have == cap) { // a single line filled the buffer
+			cap *= 2;
+			buf = (char*) realloc(buf, cap);
+		}
+	}
+	free(buf);
+
+	if(ferror(in)) {
+		perror("read");
+		closeTraceWriter(writer);
+		return 1;
+	}
+	return closeTraceWriter(writer) == 0 ? 0 : 1;
+}
+
+/*
+ * Print a binary trace in lackey's text format
+ */
+int decode(const char* file, FILE* out) {
+	binTrace trace;
+
+	if(openBinTrace(&trace, file) != 0) {
+		fprintf(stderr, "%s is not a valid binary trace\n", file);
+		return 1;
+	}
+
+	traceRecord* recs = (traceRecord*) malloc(trace.blockRecords * sizeof(traceRecord));
+	int status = 0;
+	for(unsigned long long block = 0; block < trace.numBlocks; block++) {
+		unsigned int count;
+		if(readBinBlock(&trace, block, recs, &count) != 0) {
+			fprintf(stderr, "%s is corrupt in block %llu\n", file, block);
+			status = 1;
+			break;
+		}
+		for(unsigned int i = 0; i < count; i++) {
+			if(recs[i].op == 'I') {
+				fprintf(out, "I  %llx,%u\n", recs[i].address, recs[i].len);
+			}
+			else {
+				fprintf(out, " %c %llx,%u\n", recs[i].op, recs[i].address, recs[i].len);
+			}
+		}
+	}
+	free(recs);
+	closeBinTrace(&trace);
+	return status;
+}
+
+int main(int argc, char* argv[]) {
+	char* infile = NULL;
+	char* outfile = NULL;
+	unsigned int blockRecords = TRACE_BLOCK_RECORDS;
+	int decoding = 0;
+	int opt, status;
+
+	while((opt = getopt(argc, argv, "hdB:i:o:")) != -1) {
+		switch(opt) {
+		case 'h':
+			usage(argv);
+			exit(0);
+		case 'd':
+			decoding = 1;
+			break;
+		case 'B':
+			blockRecords = atoi(optarg);
+			break;
+		case 'i':
+			infile = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+
+	if(infile == NULL || outfile == NULL || blockRecords == 0) {
+		printf("Error: Missing required argument\n");
+		usage(argv);
+		exit(1);
+	}
+
+	FILE* out = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+	if(out == NULL) {
+		perror(outfile);
+		exit(1);
+	}
+
+	if(decoding) {
+		status = decode(infile, out);
+	}
+	else {
+		FILE* in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "r");
+		if(in == NULL) {
+			perror(infile);
+			exit(1);
+		}
+		status = encode(in, out, blockRecords);
+		if(in != stdin) { fclose(in); }
+	}
+
+	if(out != stdout && fclose(out) != 0) {
+		status = 1;
+	}
+	return status;
+}
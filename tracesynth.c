@@ -0,0 +1,409 @@
+/*
+ * tracesynth.c - Generate large synthetic traces without valgrind
+ *
+ * Writes text traces (lackey's format) or, with -T, binary traces (the
+ * format in trace.h) of any length from one of these access patterns:
+ *
+ *   seq     -k interleaved sequential streams, each in its own slice of the region
+ *   stride  one stream that steps -d bytes at a time, wrapping around the region
+ *   random  uniformly random accesses anywhere in the region
+ *   zipf    blocks of the region drawn from a Zipfian distribution (-z theta),
+ *           so a small hot set gets most of the accesses
+ *   chase   pointer chasing: 8-byte loads following one random cycle through
+ *           every -e byte node in the region
+ *   tiled   transpose_submit's access pattern for an N x M matrix A and an
+ *           M x N matrix B walked in -t x -t tiles: load A[i][j], store B[j][i]
+ *
+ * The same seed always gives the same trace.
+ *
+ *   linux> ./tracesynth -p zipf -n 1000000000 -T -o zipf.btrace
+ *   linux> ./tracesynth -p tiled -M 61 -N 67 -t 8 -n 0 -o tiled.trace
+ */
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#define OUT_BUFFER (1 << 20) // bytes of text formatted before each write
+#define MAX_LINE 40 // the longest text record: " S ffffffffffffffff,4294967295\n"
+
+typedef enum pattern {
+	PATTERN_SEQ,
+	PATTERN_STRIDE,
+	PATTERN_RANDOM,
+	PATTERN_ZIPF,
+	PATTERN_CHASE,
+	PATTERN_TILED,
+	NUM_PATTERNS
+} pattern;
+
+static const char* patternNames[NUM_PATTERNS] = { "seq", "stride", "random", "zipf", "chase", "tiled" };
+
+typedef struct options {
+	pattern kind;
+	unsigned long long records; // how many to write (0 for one walk under tiled)
+	unsigned long long seed;
+	unsigned long long base; // the lowest address
+	unsigned long long region; // bytes the accesses fall in
+	unsigned int size; // bytes per access
+	int storePercent; // stores out of every 100 accesses (seq, stride, random, zipf)
+	int streams; // seq
+	unsigned long long stride; // stride, in bytes
+	double theta; // zipf skew, in (0, 1)
+	unsigned int element; // chase node size, and the zipf block size
+	int M, N, tile; // tiled
+} options;
+
+/*
+ * Text or binary output
+ */
+typedef struct output {
+	FILE* fp;
+	binTraceWriter* writer; // binary traces, or NULL for text
+	char* buf; // text waiting to be written
+	size_t used;
+} output;
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static void emit(output* out, char op, unsigned long long address, unsigned int len) {
+	if(out->writer != NULL) {
+		traceRecord rec = { address, len, op };
+		writeTraceRecord(out->writer, &rec);
+		return;
+	}
+	if(out->used + MAX_LINE > OUT_BUFFER) {
+		fwrite(out->buf, 1, out->used, out->fp);
+		out->used = 0;
+	}
+
+	char digits[20];
+	int n = 0;
+	char* p = out->buf + out->used;
+	*p++ = ' ';
+	*p++ = op;
+	*p++ = ' ';
+	do { digits[n++] = hexDigits[address & 15]; address >>= 4; } while(address != 0);
+	while(n > 0) { *p++ = digits[--n]; }
+	*p++ = ',';
+	do { digits[n++] = '0' + len % 10; len /= 10; } while(len != 0);
+	while(n > 0) { *p++ = digits[--n]; }
+	*p++ = '\n';
+	out->used = p - out->buf;
+}
+
+static int closeOutput(output* out) {
+	if(out->writer != NULL) {
+		return closeTraceWriter(out->writer);
+	}
+	fwrite(out->buf, 1, out->used, out->fp);
+	free(out->buf);
+	return ferror(out->fp) ? -1 : 0;
+}
+
+/*
+ * xorshift64*, seeded through splitmix64 so nearby seeds give unrelated streams
+ */
+static unsigned long long nextRandom(unsigned long long* state) {
+	unsigned long long x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+static unsigned long long seedRandom(unsigned long long seed) {
+	unsigned long long x = seed + 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x != 0 ? x : 1;
+}
+
+/* A uniform number in [0, n) */
+static unsigned long long below(unsigned long long* state, unsigned long long n) {
+	return (unsigned long long) (((unsigned __int128) nextRandom(state) * n) >> 64);
+}
+
+static char pickOp(const options* opt, unsigned long long* state) {
+	return (int) below(state, 100) < opt->storePercent ? 'S' : 'L';
+}
+
+/*
+ * Zipfian ranks in O(1) each after an O(n) setup (Gray et al., "Quickly
+ * generating billion-record synthetic databases")
+ */
+typedef struct zipf {
+	unsigned long long n;
+	double theta, alpha, zetan, eta, half;
+} zipfGen;
+
+static void initZipf(zipfGen* z, unsigned long long n, double theta) {
+	double zeta2 = 1.0 + pow(0.5, theta);
+	z->n = n;
+	z->theta = theta;
+	z->zetan = 0;
+	for(unsigned long long i = 1; i <= n; i++) {
+		z->zetan += pow((double) i, -theta);
+	}
+	z->alpha = 1.0 / (1.0 - theta);
+	z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+	z->half = 1.0 + pow(0.5, theta);
+}
+
+static unsigned long long nextZipf(zipfGen* z, unsigned long long* state) {
+	double u = (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+	double uz = u * z->zetan;
+	if(uz < 1.0) {
+		return 0;
+	}
+	if(uz < z->half) {
+		return 1;
+	}
+	unsigned long long rank = (unsigned long long) (z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+	return rank < z->n ? rank : z->n - 1;
+}
+
+/*
+ * One walk of transpose_submit's pattern, stopping early after limit records (0 for no limit)
+ */
+static unsigned long long tiledWalk(const options* opt, output* out, unsigned long long limit) {
+	unsigned long long a = opt->base;
+	unsigned long long b = a + (unsigned long long) opt->M * opt->N * sizeof(int);
+	unsigned long long count = 0;
+
+	for(int rblock = 0; rblock < opt->N; rblock += opt->tile) {
+		for(int cblock = 0; cblock < opt->M; cblock += opt->tile) {
+			for(int i = rblock; i < rblock + opt->tile && i < opt->N; i++) {
+				for(int j = cblock; j < cblock + opt->tile && j < opt->M; j++) {
+					emit(out, 'L', a + ((unsigned long long) i * opt->M + j) * sizeof(int), sizeof(int));
+					emit(out, 'S', b + ((unsigned long long) j * opt->N + i) * sizeof(int), sizeof(int));
+					count += 2;
+					if(limit != 0 && count >= limit) {
+						return count;
+					}
+				}
+			}
+		}
+	}
+	return count;
+}
+
+int generate(const options* opt, output* out) {
+	unsigned long long state = seedRandom(opt->seed);
+	unsigned long long slots = opt->region / opt->size; // places an access can go
+	unsigned long long i;
+
+	switch(opt->kind) {
+	case PATTERN_SEQ: {
+		unsigned long long slice = slots / opt->streams; // each stream's share of the region
+		for(i = 0; i < opt->records; i++) {
+			unsigned long long stream = i % opt->streams;
+			unsigned long long step = (i / opt->streams) % slice;
+			emit(out, pickOp(opt, &state), opt->base + (stream * slice + step) * opt->size, opt->size);
+		}
+		break;
+	}
+	case PATTERN_STRIDE: {
+		unsigned long long offset = 0;
+		for(i = 0; i < opt->records; i++) {
+			emit(out, pickOp(opt, &state), opt->base + offset, opt->size);
+			offset = (offset + opt->stride) % opt->region;
+		}
+		break;
+	}
+	case PATTERN_RANDOM:
+		for(i = 0; i < opt->records; i++) {
+			emit(out, pickOp(opt, &state), opt->base + below(&state, slots) * opt->size, opt->size);
+		}
+		break;
+	case PATTERN_ZIPF: {
+		zipfGen z;
+		unsigned long long blocks = opt->region / opt->element;
+		initZipf(&z, blocks, opt->theta);
+		for(i = 0; i < opt->records; i++) {
+			unsigned long long block = nextZipf(&z, &state);
+			unsigned long long within = below(&state, opt->element / opt->size) * opt->size;
+			emit(out, pickOp(opt, &state), opt->base + block * opt->element + within, opt->size);
+		}
+		break;
+	}
+	case PATTERN_CHASE: {
+		unsigned long long nodes = opt->region / opt->element;
+		unsigned int* next = (unsigned int*) malloc(nodes * sizeof(unsigned int));
+		if(next == NULL) {
+			fprintf(stderr, "Too many nodes to chase\n");
+			return 1;
+		}
+		for(i = 0; i < nodes; i++) {
+			next[i] = i;
+		}
+		for(i = nodes - 1; i > 0; i--) { // Sattolo's shuffle leaves one cycle through every node
+			unsigned long long j = below(&state, i);
+			unsigned int t = next[i];
+			next[i] = next[j];
+			next[j] = t;
+		}
+		unsigned long long node = 0;
+		for(i = 0; i < opt->records; i++) {
+			emit(out, 'L', opt->base + node * opt->element, 8);
+			node = next[node];
+		}
+		free(next);
+		break;
+	}
+	default:
+		if(opt->records == 0) {
+			tiledWalk(opt, out, 0);
+		}
+		for(i = 0; i < opt->records; ) {
+			i += tiledWalk(opt, out, opt->records - i);
+		}
+		break;
+	}
+	return 0;
+}
+
+void usage(char* argv[]) {
+	printf("Usage: %s [-hT] -p <pattern> [-n <records>] [-S <seed>] [options] -o <outfile>\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h            Print this help message.\n");
+	printf("  -T            Write a binary trace instead of text.\n");
+	printf("  -p <pattern>  seq, stride, random, zipf, chase or tiled.\n");
+	printf("  -n <records>  Records to write (default 1000000; 0 under tiled is one walk).\n");
+	printf("  -S <seed>     Random seed (default 1).\n");
+	printf("  -a <base>     Lowest address, in hex (default 10000000).\n");
+	printf("  -r <bytes>    Size of the region the accesses fall in (default 64M; K, M and G work).\n");
+	printf("  -l <bytes>    Bytes per access (default 4).\n");
+	printf("  -w <percent>  Percentage of stores (default 0).\n");
+	printf("  -k <streams>  Streams under seq (default 1).\n");
+	printf("  -d <bytes>    Step under stride (default 64).\n");
+	printf("  -z <theta>    Skew under zipf, between 0 and 1 (default 0.99).\n");
+	printf("  -e <bytes>    Node size under chase and block size under zipf (default 64).\n");
+	printf("  -M <cols> -N <rows> -t <tile>  Matrix shape and tile size under tiled (default 32, 32, 8).\n");
+	printf("  -o <outfile>  Trace to write (\"-\" for stdout).\n");
+}
+
+/*
+ * A byte count with an optional K, M or G suffix
+ */
+unsigned long long parseBytes(const char* arg) {
+	char* end;
+	unsigned long long value = strtoull(arg, &end, 0);
+	switch(*end) {
+	case 'G': case 'g': value <<= 10; // fall through
+	case 'M': case 'm': value <<= 10; // fall through
+	case 'K': case 'k': value <<= 10; break;
+	}
+	return value;
+}
+
+int main(int argc, char* argv[]) {
+	options opt = { PATTERN_SEQ, 1000000, 1, 0x10000000ULL, 64ULL << 20, 4, 0, 1, 64, 0.99, 64, 32, 32, 8 };
+	char* outfile = NULL;
+	int binary = 0, kind = -1;
+	int c, status;
+
+	while((c = getopt(argc, argv, "hTp:n:S:a:r:l:w:k:d:z:e:M:N:t:o:")) != -1) {
+		switch(c) {
+		case 'h':
+			usage(argv);
+			exit(0);
+		case 'T':
+			binary = 1;
+			break;
+		case 'p':
+			for(int i = 0; i < NUM_PATTERNS; i++) {
+				if(strcmp(optarg, patternNames[i]) == 0) {
+					kind = i;
+				}
+			}
+			break;
+		case 'n':
+			opt.records = strtoull(optarg, NULL, 10);
+			break;
+		case 'S':
+			opt.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'a':
+			opt.base = strtoull(optarg, NULL, 16);
+			break;
+		case 'r':
+			opt.region = parseBytes(optarg);
+			break;
+		case 'l':
+			opt.size = atoi(optarg);
+			break;
+		case 'w':
+			opt.storePercent = atoi(optarg);
+			break;
+		case 'k':
+			opt.streams = atoi(optarg);
+			break;
+		case 'd':
+			opt.stride = parseBytes(optarg);
+			break;
+		case 'z':
+			opt.theta = atof(optarg);
+			break;
+		case 'e':
+			opt.element = parseBytes(optarg);
+			break;
+		case 'M':
+			opt.M = atoi(optarg);
+			break;
+		case 'N':
+			opt.N = atoi(optarg);
+			break;
+		case 't':
+			opt.tile = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+
+	if(kind < 0 || outfile == NULL) {
+		printf("Error: Missing or unknown argument\n");
+		usage(argv);
+		exit(1);
+	}
+	opt.kind = kind;
+	if(opt.size == 0 || opt.element < opt.size || opt.element < 8 || opt.region < opt.element
+			|| opt.streams < 1 || (unsigned long long) opt.streams > opt.region / opt.size
+			|| opt.theta <= 0 || opt.theta >= 1 || opt.M < 1 || opt.N < 1 || opt.tile < 1
+			|| opt.region / opt.element > 0xffffffffULL) {
+		printf("Error: Invalid pattern parameters\n");
+		usage(argv);
+		exit(1);
+	}
+
+	FILE* fp = strcmp(outfile, "-") == 0 ? stdout : fopen(outfile, "wb");
+	if(fp == NULL) {
+		perror(outfile);
+		exit(1);
+	}
+	output out = { fp, NULL, NULL, 0 };
+	if(binary) {
+		out.writer = newTraceWriter(fp, TRACE_BLOCK_RECORDS);
+	}
+	else {
+		out.buf = (char*) malloc(OUT_BUFFER);
+	}
+
+	status = generate(&opt, &out);
+	if(closeOutput(&out) != 0) {
+		status = 1;
+	}
+	if(fp != stdout && fclose(fp) != 0) {
+		status = 1;
+	}
+	return status;
+}
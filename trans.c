@@ -17,6 +17,7 @@
 #include "cachelab.h"
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+void trans_blocked(int M, int N, int A[N][M], int B[M][N]);
 
 /* 
  * transpose_submit - This is the solution transpose function that you
@@ -67,6 +68,9 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 			}
 		}
 	}
+	else { // any other shape gets the geometry-generic blocked transpose
+		trans_blocked(M, N, A, B);
+	}
 }
 
 /*
@@ -91,6 +95,282 @@ void trans(int M, int N, int A[N][M], int B[M][N])
 
 }
 
+/*
+ * Vector transposes. Each tile is loaded a row at a time, transposed in
+ * registers and stored a column at a time, with the edges of shapes that
+ * don't divide evenly done one element at a time. The kernels are compiled
+ * with target attributes, and registerFunctions only registers them if the
+ * CPU has the instructions; otherwise it registers scalar fallbacks that
+ * walk the same tiles.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/*
+ * transpose_edges - Transpose the rows from row0 on and the columns from
+ *     col0 on, which the tiled part of a vector transpose left out
+ */
+static void transpose_edges(int M, int N, int A[N][M], int B[M][N], int row0, int col0)
+{
+	int i, j;
+
+	for (i = 0; i < N; i++)
+		for (j = i < row0 ? col0 : 0; j < M; j++)
+			B[j][i] = A[i][j];
+}
+
+/*
+ * transpose_scalar_tiles - The scalar fallback: the same size x size tiles, an element at a time
+ */
+static void transpose_scalar_tiles(int M, int N, int A[N][M], int B[M][N], int size)
+{
+	int i, j, ii, jj;
+	int rows = N - N % size, cols = M - M % size;
+
+	for (ii = 0; ii < rows; ii += size)
+		for (jj = 0; jj < cols; jj += size)
+			for (i = ii; i < ii + size; i++)
+				for (j = jj; j < jj + size; j++)
+					B[j][i] = A[i][j];
+	transpose_edges(M, N, A, B, rows, cols);
+}
+
+char trans_scalar8_desc[] = "Scalar 8x8 tiles (AVX2 fallback)";
+void trans_scalar8(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_scalar_tiles(M, N, A, B, 8);
+}
+
+char trans_scalar4_desc[] = "Scalar 4x4 tiles (SSE fallback)";
+void trans_scalar4(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_scalar_tiles(M, N, A, B, 4);
+}
+
+#ifdef HAVE_X86_SIMD
+char trans_avx2_desc[] = "AVX2 8x8 in-register transpose";
+__attribute__((target("avx2")))
+void trans_avx2(int M, int N, int A[N][M], int B[M][N])
+{
+	int ii, jj;
+	int rows = N - N % 8, cols = M - M % 8;
+	__m256i r0, r1, r2, r3, r4, r5, r6, r7, t0, t1, t2, t3, t4, t5, t6, t7;
+
+	for (ii = 0; ii < rows; ii += 8) {
+		for (jj = 0; jj < cols; jj += 8) {
+			r0 = _mm256_loadu_si256((const __m256i*) &A[ii][jj]);
+			r1 = _mm256_loadu_si256((const __m256i*) &A[ii + 1][jj]);
+			r2 = _mm256_loadu_si256((const __m256i*) &A[ii + 2][jj]);
+			r3 = _mm256_loadu_si256((const __m256i*) &A[ii + 3][jj]);
+			r4 = _mm256_loadu_si256((const __m256i*) &A[ii + 4][jj]);
+			r5 = _mm256_loadu_si256((const __m256i*) &A[ii + 5][jj]);
+			r6 = _mm256_loadu_si256((const __m256i*) &A[ii + 6][jj]);
+			r7 = _mm256_loadu_si256((const __m256i*) &A[ii + 7][jj]);
+			/* Interleave pairs of rows by 32 bits, then pairs of those by 64 bits */
+			t0 = _mm256_unpacklo_epi32(r0, r1);
+			t1 = _mm256_unpackhi_epi32(r0, r1);
+			t2 = _mm256_unpacklo_epi32(r2, r3);
+			t3 = _mm256_unpackhi_epi32(r2, r3);
+			t4 = _mm256_unpacklo_epi32(r4, r5);
+			t5 = _mm256_unpackhi_epi32(r4, r5);
+			t6 = _mm256_unpacklo_epi32(r6, r7);
+			t7 = _mm256_unpackhi_epi32(r6, r7);
+			r0 = _mm256_unpacklo_epi64(t0, t2);
+			r1 = _mm256_unpackhi_epi64(t0, t2);
+			r2 = _mm256_unpacklo_epi64(t1, t3);
+			r3 = _mm256_unpackhi_epi64(t1, t3);
+			r4 = _mm256_unpacklo_epi64(t4, t6);
+			r5 = _mm256_unpackhi_epi64(t4, t6);
+			r6 = _mm256_unpacklo_epi64(t5, t7);
+			r7 = _mm256_unpackhi_epi64(t5, t7);
+			/* and swap the 128-bit halves between rows 0-3 and 4-7 */
+			_mm256_storeu_si256((__m256i*) &B[jj][ii], _mm256_permute2x128_si256(r0, r4, 0x20));
+			_mm256_storeu_si256((__m256i*) &B[jj + 1][ii], _mm256_permute2x128_si256(r1, r5, 0x20));
+			_mm256_storeu_si256((__m256i*) &B[jj + 2][ii], _mm256_permute2x128_si256(r2, r6, 0x20));
+			_mm256_storeu_si256((__m256i*) &B[jj + 3][ii], _mm256_permute2x128_si256(r3, r7, 0x20));
+			_mm256_storeu_si256((__m256i*) &B[jj + 4][ii], _mm256_permute2x128_si256(r0, r4, 0x31));
+			_mm256_storeu_si256((__m256i*) &B[jj + 5][ii], _mm256_permute2x128_si256(r1, r5, 0x31));
+			_mm256_storeu_si256((__m256i*) &B[jj + 6][ii], _mm256_permute2x128_si256(r2, r6, 0x31));
+			_mm256_storeu_si256((__m256i*) &B[jj + 7][ii], _mm256_permute2x128_si256(r3, r7, 0x31));
+		}
+	}
+	transpose_edges(M, N, A, B, rows, cols);
+}
+
+char trans_sse_desc[] = "SSE2 4x4 in-register transpose";
+void trans_sse(int M, int N, int A[N][M], int B[M][N])
+{
+	int ii, jj;
+	int rows = N - N % 4, cols = M - M % 4;
+	__m128i r0, r1, r2, r3, t0, t1, t2, t3;
+
+	for (ii = 0; ii < rows; ii += 4) {
+		for (jj = 0; jj < cols; jj += 4) {
+			r0 = _mm_loadu_si128((const __m128i*) &A[ii][jj]);
+			r1 = _mm_loadu_si128((const __m128i*) &A[ii + 1][jj]);
+			r2 = _mm_loadu_si128((const __m128i*) &A[ii + 2][jj]);
+			r3 = _mm_loadu_si128((const __m128i*) &A[ii + 3][jj]);
+			t0 = _mm_unpacklo_epi32(r0, r1);
+			t1 = _mm_unpacklo_epi32(r2, r3);
+			t2 = _mm_unpackhi_epi32(r0, r1);
+			t3 = _mm_unpackhi_epi32(r2, r3);
+			_mm_storeu_si128((__m128i*) &B[jj][ii], _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128((__m128i*) &B[jj + 1][ii], _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128((__m128i*) &B[jj + 2][ii], _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128((__m128i*) &B[jj + 3][ii], _mm_unpackhi_epi64(t2, t3));
+		}
+	}
+	transpose_edges(M, N, A, B, rows, cols);
+}
+#endif
+
+/*
+ * Geometry-generic transposes. TRANS_S, TRANS_E and TRANS_B describe the
+ * cache they're laid out for, 2^s sets of E lines of 2^b bytes, and
+ * default to the graded one; build with e.g. -DTRANS_S=6 -DTRANS_E=8
+ * -DTRANS_B=6 for a typical L1. The element size comes from the matrices.
+ * Every variant handles any M x N, prime dimensions included.
+ */
+#ifndef TRANS_S
+#define TRANS_S 5
+#endif
+#ifndef TRANS_E
+#define TRANS_E 1
+#endif
+#ifndef TRANS_B
+#define TRANS_B 5
+#endif
+#define TRANS_ELEM ((int) sizeof(int)) /* the size of a matrix element */
+#define MAX_LINE_ELEMS 16 /* elements per line the kernels can hold: 64 bytes of ints */
+#define MAX_TILE_LINES 4 /* lines of each B row the blocked transpose keeps at once */
+
+/* Elements per line, capped at what transpose_tile can stage */
+#define LINE_ELEMS(b) ((1 << (b)) / TRANS_ELEM < MAX_LINE_ELEMS ? (1 << (b)) / TRANS_ELEM : MAX_LINE_ELEMS)
+
+/*
+ * transpose_tile - Transpose A's rows [i0, i1) and columns [j0, j1),
+ *     j1 - j0 <= MAX_LINE_ELEMS, a row at a time. Each row segment is
+ *     copied into locals before any of it is stored, so the line of A it
+ *     came from is done with even if a store to B evicts it.
+ */
+static inline void transpose_tile(int M, int N, int A[N][M], int B[M][N], int i0, int i1, int j0, int j1)
+{
+	int row[MAX_LINE_ELEMS];
+	int i, j;
+
+	for (i = i0; i < i1; i++) {
+		for (j = j0; j < j1; j++)
+			row[j - j0] = A[i][j];
+		for (j = j0; j < j1; j++)
+			B[j][i] = row[j - j0];
+	}
+}
+
+/*
+ * tile_fits - Whether lines consecutive lines from each of rows rows,
+ *     stride elements apart, fit in 2^s sets of E ways with a line to
+ *     spare in every set they use (for the row of A being copied)
+ */
+static int tile_fits(int stride, int rows, int lines, int s, int E, int b)
+{
+	long long first[MAX_LINE_ELEMS * MAX_TILE_LINES]; /* each distinct line of the tile */
+	int count = 0, r, q, k, same;
+	long long line;
+
+	for (r = 0; r < rows; r++) {
+		for (q = 0; q < lines; q++) {
+			line = (((long long) r * stride * TRANS_ELEM) >> b) + q;
+			for (k = 0; k < count && first[k] != line; k++)
+				;
+			if (k == count)
+				first[count++] = line;
+		}
+	}
+	for (k = 0; k < count; k++) {
+		same = 0;
+		for (q = 0; q < count; q++)
+			same += ((first[q] - first[k]) & ((1 << s) - 1)) == 0;
+		if (same > (E > 1 ? E - 1 : 1))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * transpose_geometry - Blocked transpose for a cache of 2^s sets of E
+ *     lines of 2^b bytes. A tile is as many of B's rows as fit in the
+ *     cache together, at most a line's worth, by as many of their lines
+ *     as still fit. It's always inlined, so the wrappers below that pass
+ *     constant geometries get a copy specialized for theirs.
+ */
+static inline __attribute__((always_inline))
+void transpose_geometry(int M, int N, int A[N][M], int B[M][N], int s, int E, int b)
+{
+	int line = LINE_ELEMS(b);
+	int width = line, lines = 1;
+	int ii, jj;
+
+	while (width > 1 && !tile_fits(N, width, 1, s, E, b))
+		width--;
+	if (width == 1) /* B's rows all alias; at least use whole lines of A */
+		width = line;
+	while (lines < MAX_TILE_LINES && tile_fits(N, width, lines + 1, s, E, b))
+		lines++;
+
+	for (jj = 0; jj < M; jj += width)
+		for (ii = 0; ii < N; ii += line * lines)
+			transpose_tile(M, N, A, B, ii, ii + line * lines < N ? ii + line * lines : N,
+				       jj, jj + width < M ? jj + width : M);
+}
+
+char trans_blocked_desc[] = "Blocked transpose for the target cache";
+void trans_blocked(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_geometry(M, N, A, B, TRANS_S, TRANS_E, TRANS_B);
+}
+
+char trans_blocked_l1_desc[] = "Blocked transpose for a 32KB 8-way L1 with 64-byte lines";
+void trans_blocked_l1(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_geometry(M, N, A, B, 6, 8, 6);
+}
+
+/*
+ * transpose_oblivious - Halve the longer side of A's rows [i0, i1) and
+ *     columns [j0, j1) until both fit in a line of line elements. The
+ *     halves are rounded to whole lines, which is the only thing about the
+ *     cache it knows.
+ */
+static void transpose_oblivious(int M, int N, int A[N][M], int B[M][N], int i0, int i1, int j0, int j1, int line)
+{
+	int half;
+
+	if (i1 - i0 <= line && j1 - j0 <= line) {
+		transpose_tile(M, N, A, B, i0, i1, j0, j1);
+		return;
+	}
+	if (i1 - i0 >= j1 - j0) {
+		half = (i1 - i0) / 2;
+		half = (half + line - 1) / line * line;
+		transpose_oblivious(M, N, A, B, i0, i0 + half, j0, j1, line);
+		transpose_oblivious(M, N, A, B, i0 + half, i1, j0, j1, line);
+	}
+	else {
+		half = (j1 - j0) / 2;
+		half = (half + line - 1) / line * line;
+		transpose_oblivious(M, N, A, B, i0, i1, j0, j0 + half, line);
+		transpose_oblivious(M, N, A, B, i0, i1, j0 + half, j1, line);
+	}
+}
+
+char trans_oblivious_desc[] = "Recursive cache-oblivious transpose";
+void trans_oblivious(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_oblivious(M, N, A, B, 0, N, 0, M, LINE_ELEMS(TRANS_B));
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -106,6 +386,30 @@ void registerFunctions()
 	/* Register any additional transpose functions */
 	registerTransFunction(trans, trans_desc);
 
+	/* The vector transposes, or their scalar fallbacks on CPUs without them */
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		registerTransFunction(trans_avx2, trans_avx2_desc);
+	else
+		registerTransFunction(trans_scalar8, trans_scalar8_desc);
+	if (__builtin_cpu_supports("sse2"))
+		registerTransFunction(trans_sse, trans_sse_desc);
+	else
+		registerTransFunction(trans_scalar4, trans_scalar4_desc);
+#else
+	registerTransFunction(trans_scalar8, trans_scalar8_desc);
+	registerTransFunction(trans_scalar4, trans_scalar4_desc);
+#endif
+
+	/* The geometry-generic transposes */
+	registerTransFunction(trans_blocked, trans_blocked_desc);
+	registerTransFunction(trans_blocked_l1, trans_blocked_l1_desc);
+	registerTransFunction(trans_oblivious, trans_oblivious_desc);
+
+	/* Register the output of transtune, if there is any */
+	if (registerTunedFunctions)
+		registerTunedFunctions();
 }
 
 /*
@@ -0,0 +1,145 @@
+/*
+ * transbench.c - Measure how the parallel tiled transpose scales
+ *
+ * Transposes an n x n matrix (16384 x 16384 by default, 1GB each for A and
+ * B) with parallelTranspose on 1, 2, 4, ... threads up to -j, and on -j
+ * itself. The matrices are filled once by -j threads, so first-touch puts
+ * each band on the node of the thread that works on it (see bigtrans.h).
+ * Every run is checked against A, and the best of the trials is printed
+ * and written as CSV with the speedup over one thread.
+ *
+ *   linux> make bench-trans
+ *   linux> ./trans-bench -n 4096 -j 8 -H
+ */
+#define _GNU_SOURCE
+#include "bigtrans.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SIZE 16384
+#define DEFAULT_TILE 32
+#define DEFAULT_TRIALS 3
+
+void usage(char* argv[]) {
+	printf("Usage: %s [-hH] [-n <size>] [-j <threads>] [-b <tile>] [-r <trials>] [-o <csv>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h            Print this help message.\n");
+	printf("  -H            Put the matrices on transparent huge pages.\n");
+	printf("  -n <size>     Transpose size x size matrices (default %d).\n", DEFAULT_SIZE);
+	printf("  -j <threads>  Scale up to this many threads (default: every CPU).\n");
+	printf("  -b <tile>     Tile size (default %d).\n", DEFAULT_TILE);
+	printf("  -r <trials>   Trials per thread count (default %d).\n", DEFAULT_TRIALS);
+	printf("  -o <csv>      Where to write the results (default trans-bench.csv).\n");
+}
+
+static double seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Time one thread count and report it on stdout and in the CSV. *base is
+ * the one-thread time, set by the first call.
+ */
+int bench(FILE* csv, int n, int* A, int* B, int tile, int threads, int trials, double* base) {
+	double best = 0;
+	for(int t = 0; t < trials; t++) {
+		double start = seconds();
+		parallelTranspose(n, n, A, B, tile, threads);
+		double elapsed = seconds() - start;
+		if(t == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+	if(!checkTranspose(n, n, A, B)) {
+		fprintf(stderr, "The transpose on %d threads is wrong\n", threads);
+		return 1;
+	}
+
+	if(*base == 0) {
+		*base = best;
+	}
+	double rate = 2.0 * n * n * sizeof(int) / best / 1e9;
+	double speedup = *base / best;
+	printf("j=%-4d %8.3fs %8.2f GB/s %6.2fx speedup %5.1f%% efficiency\n",
+			threads, best, rate, speedup, 100 * speedup / threads);
+	fprintf(csv, "%d,%d,%d,%d,%.6f,%.3f,%.3f\n", n, tile, threads, trials, best, rate, speedup);
+	fflush(stdout);
+	fflush(csv);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int n = DEFAULT_SIZE, tile = DEFAULT_TILE, trials = DEFAULT_TRIALS, huge = 0;
+	int maxThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	char* outfile = "trans-bench.csv";
+	int opt, status = 0;
+
+	while((opt = getopt(argc, argv, "hHn:j:b:r:o:")) != -1) {
+		switch(opt) {
+		case 'h':
+			usage(argv);
+			exit(0);
+		case 'H':
+			huge = 1;
+			break;
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'j':
+			maxThreads = atoi(optarg);
+			break;
+		case 'b':
+			tile = atoi(optarg);
+			break;
+		case 'r':
+			trials = atoi(optarg);
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+	if(maxThreads > MAX_TRANS_THREADS) {
+		maxThreads = MAX_TRANS_THREADS;
+	}
+	if(n < 1 || tile < 1 || trials < 1 || maxThreads < 1) {
+		usage(argv);
+		exit(1);
+	}
+
+	int* A = newMatrix(n, n, huge);
+	int* B = newMatrix(n, n, huge);
+	if(A == NULL || B == NULL) {
+		fprintf(stderr, "Can't allocate two %dx%d matrices\n", n, n);
+		exit(1);
+	}
+	FILE* csv = fopen(outfile, "w");
+	if(csv == NULL) {
+		perror(outfile);
+		exit(1);
+	}
+	fprintf(csv, "n,tile,threads,trials,seconds,gb_per_sec,speedup\n");
+
+	printf("Transposing %dx%d matrices in %dx%d tiles%s\n", n, n, tile, tile, huge ? " on huge pages" : "");
+	fillMatrices(n, n, A, B, maxThreads);
+	double base = 0;
+	int threads;
+	for(threads = 1; threads < maxThreads; threads *= 2) {
+		status |= bench(csv, n, A, B, tile, threads, trials, &base);
+	}
+	status |= bench(csv, n, A, B, tile, maxThreads, trials, &base);
+
+	fclose(csv);
+	freeMatrix(A, n, n);
+	freeMatrix(B, n, n);
+	printf("Results are in %s\n", outfile);
+	return status;
+}
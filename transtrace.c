@@ -0,0 +1,149 @@
+/*
+ * transtrace.c - The matrices transpose functions run on, and an
+ *     in-memory recorder standing in for the ThreadSanitizer runtime
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "transtrace.h"
+
+/* External variables declared in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+tracedData traced __attribute__((aligned(4096)));
+
+static int tracing = 0;
+static traceRecord* records = NULL;
+static unsigned int num_records = 0, max_records = 0;
+static const char* stack_low;
+static const char* stack_high;
+static const char* locals[MAX_TRACED_LOCALS][2]; /* [start, end) of each declared local */
+static int num_locals = 0;
+
+/*
+ * initTraced - Set up the matrices and functions for runTraced
+ */
+void initTraced(int M, int N)
+{
+    traced.M = M;
+    traced.N = N;
+    initMatrix(M, N, traced.A, traced.B);
+    memcpy(traced.funcs, func_list, func_counter * sizeof(trans_func_t));
+}
+
+/*
+ * validateTraced - Compare the last transpose against the baseline
+ */
+int validateTraced(int fn)
+{
+    int M = traced.M, N = traced.N;
+    int (*B)[N] = (int (*)[N]) traced.B; /* the functions see B as M by N */
+    int (*C)[N] = calloc(M, sizeof(*C));
+    int i, j, ok = 1;
+
+    correctTrans(M, N, traced.A, C);
+    for (i = 0; i < M && ok; i++) {
+        for (j = 0; j < N && ok; j++) {
+            if (B[i][j] != C[i][j]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",
+                       fn, C[i][j], B[i][j], i, j);
+                ok = 0;
+            }
+        }
+    }
+    free(C);
+    return ok;
+}
+
+/*
+ * startTrace - Forget the last trace and find the stack, whose accesses aren't recorded
+ */
+void startTrace(void)
+{
+    pthread_attr_t attr;
+    void* addr;
+    size_t size;
+
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        pthread_attr_getstack(&attr, &addr, &size);
+        stack_low = addr;
+        stack_high = (const char*) addr + size;
+        pthread_attr_destroy(&attr);
+    }
+    num_records = 0;
+    num_locals = 0;
+    tracing = 1;
+}
+
+void stopTrace(void)
+{
+    tracing = 0;
+}
+
+const traceRecord* tracedRecords(unsigned int* count)
+{
+    *count = num_records;
+    return records;
+}
+
+void traceLocal(const void* addr, size_t size)
+{
+    if (tracing && num_locals < MAX_TRACED_LOCALS) {
+        locals[num_locals][0] = addr;
+        locals[num_locals][1] = (const char*) addr + size;
+        num_locals++;
+    }
+}
+
+/*
+ * record - Append one access, unless it's to the stack and not a declared local
+ */
+static void record(char op, const void* addr, unsigned int size)
+{
+    const char* p = addr;
+    int i;
+
+    if (!tracing)
+        return;
+    if (p >= stack_low && p < stack_high) {
+        for (i = 0; i < num_locals; i++)
+            if (p >= locals[i][0] && p < locals[i][1])
+                break;
+        if (i == num_locals)
+            return;
+    }
+    if (num_records == max_records) {
+        max_records = max_records ? 2 * max_records : 1 << 16;
+        records = realloc(records, max_records * sizeof(traceRecord));
+    }
+    records[num_records].op = op;
+    records[num_records].address = (unsigned long long) p;
+    records[num_records].len = size;
+    num_records++;
+}
+
+/*
+ * The hooks -fsanitize=thread calls. Only loads and stores matter here.
+ */
+#define ACCESS_HOOKS(n) \
+    void __tsan_read##n(void* addr) { record('L', addr, n); } \
+    void __tsan_write##n(void* addr) { record('S', addr, n); } \
+    void __tsan_unaligned_read##n(void* addr) { record('L', addr, n); } \
+    void __tsan_unaligned_write##n(void* addr) { record('S', addr, n); } \
+    void __tsan_volatile_read##n(void* addr) { record('L', addr, n); } \
+    void __tsan_volatile_write##n(void* addr) { record('S', addr, n); }
+
+ACCESS_HOOKS(1)
+ACCESS_HOOKS(2)
+ACCESS_HOOKS(4)
+ACCESS_HOOKS(8)
+ACCESS_HOOKS(16)
+
+void __tsan_read_range(void* addr, unsigned long size) { record('L', addr, size); }
+void __tsan_write_range(void* addr, unsigned long size) { record('S', addr, size); }
+void __tsan_init(void) { }
+void __tsan_func_entry(void* pc) { }
+void __tsan_func_exit(void) { }
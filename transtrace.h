@@ -0,0 +1,62 @@
+/*
+ * transtrace.h - Tracing transpose functions without valgrind
+ *
+ * tracegen and test-trans run each transpose function on the matrices in
+ * "traced", between stores to its two markers. Under valgrind the markers
+ * bound the part of the lackey trace that belongs to the function. In the
+ * instrumented build, trans.c and tracecall.c are compiled with
+ * -fsanitize=thread, and transtrace.c supplies the hooks in place of the
+ * ThreadSanitizer runtime. Every load and store is then recorded straight
+ * into memory, skipping the stack the way the lackey path's address filter
+ * does.
+ *
+ * traced is page aligned and laid out like tracegen's original globals, so
+ * both paths see the same addresses modulo the page size and so the same
+ * hits, misses and evictions.
+ */
+#ifndef CACHELAB_TRANSTRACE_H
+#define CACHELAB_TRANSTRACE_H
+
+#include <stddef.h>
+#include "cachelab.h"
+#include "trace.h"
+
+#define TRACE_MAXN 256 /* the largest matrix dimension */
+#define MAX_TRACED_LOCALS 16 /* stack ranges traceLocal can declare at once */
+
+typedef struct tracedData {
+  volatile char markerStart; /* stored to just before the function runs */
+  volatile char markerEnd;   /* stored to just after it returns */
+  int A[TRACE_MAXN][TRACE_MAXN] __attribute__((aligned(32)));
+  int B[TRACE_MAXN][TRACE_MAXN];
+  int M;
+  int N;
+  trans_func_t funcs[MAX_TRANS_FUNCS] __attribute__((aligned(32))); /* copied from func_list */
+} tracedData;
+
+extern tracedData traced;
+
+/* Set the dimensions, fill A and B and copy the registered functions */
+void initTraced(int M, int N);
+
+/* Run function fn on traced.A and traced.B between the markers (tracecall.c) */
+void runTraced(int fn);
+
+/* Check traced.B against correctTrans, printing what's wrong. Returns 1 if it's right. */
+int validateTraced(int fn);
+
+/* Record every access the instrumented code makes until stopTrace */
+void startTrace(void);
+void stopTrace(void);
+
+/* The accesses recorded by the last startTrace/stopTrace pair */
+const traceRecord* tracedRecords(unsigned int* count);
+
+/*
+ * traceLocal - Record accesses to a local variable too. Locals are on the
+ *     stack, which the lackey path can't tell apart from valgrind's own
+ *     accesses, so declaring them makes the two paths differ.
+ */
+void traceLocal(const void* addr, size_t size);
+
+#endif /* CACHELAB_TRANSTRACE_H */
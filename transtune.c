@@ -0,0 +1,386 @@
+/*
+ * transtune.c - Search for the transpose with the fewest simulated misses
+ *
+ * For one matrix shape and cache geometry, transtune replays the loads of
+ * A and stores to B that each candidate transpose makes through the
+ * in-process simulator, at the addresses test-trans runs them at (see
+ * transtrace.h) and along with the few accesses runTraced makes around the
+ * call, so the misses it reports are the ones test-trans will. It tries every tile size, both tile orders and four tile
+ * kernels:
+ *
+ *   plain              B[j][i] = A[i][j] across each tile row
+ *   deferred-diagonal  the same, but A[i][i] is held in a local and stored
+ *                      after the rest of its row, so A and B don't take
+ *                      turns evicting each other on the diagonal
+ *   row-staged         a tile row of up to 8 elements is loaded into
+ *                      locals before any of it is stored
+ *   in-place           a square tile of up to 8 is copied into B row by row
+ *                      through locals and then transposed inside B
+ *
+ * The best one is written out as C (trans-tuned.c by default). When that
+ * file is present the Makefile links it into test-trans and tracegen, and
+ * registerFunctions picks it up through registerTunedFunctions.
+ *
+ *   linux> ./transtune -M 64 -N 64
+ *   linux> make && ./test-trans -M 64 -N 64
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <getopt.h>
+#include "cachelab.h"
+#include "transtrace.h"
+
+#define MAX_TILE 32 /* the largest tile side tried by the kernels without locals */
+#define MAX_STAGED 8 /* the most elements staged through locals (t0-t7) */
+#define TRACED_BASE 0x600000ULL /* any page aligned address stands in for &traced */
+#define SHOWN 10 /* candidates listed */
+
+enum { KERNEL_PLAIN, KERNEL_DEFER, KERNEL_STAGED, KERNEL_INPLACE, NUM_KERNELS };
+
+static const char* kernel_names[NUM_KERNELS] = { "plain", "deferred-diagonal", "row-staged", "in-place" };
+
+typedef struct tune_config {
+    int kernel;
+    int cols_outer; /* walk tile columns in the outer loop instead of tile rows */
+    int bh; /* tile height (rows of A) */
+    int bw; /* tile width (columns of A) */
+    unsigned long long misses;
+    unsigned long long hits;
+} tune_config_t;
+
+/* External function defined in trans.c */
+extern void registerFunctions();
+
+/* External variables defined in cachelab.c */
+extern int func_counter;
+
+static int M, N;
+static unsigned long long a_base, b_base;
+static int tuned_index; /* where the tuned function will be in func_list */
+
+#define TRACED_ADDR(field) (TRACED_BASE + offsetof(tracedData, field))
+
+#define LOAD_A(sim, i, j) cacheSimAccess(sim, 'L', a_base + ((unsigned long long) (i) * M + (j)) * 4, 4)
+#define STORE_B(sim, j, i) cacheSimAccess(sim, 'S', b_base + ((unsigned long long) (j) * N + (i)) * 4, 4)
+#define LOAD_B(sim, j, i) cacheSimAccess(sim, 'L', b_base + ((unsigned long long) (j) * N + (i)) * 4, 4)
+
+/*
+ * row_staged - The accesses of one row-staged tile row. in_place_tile
+ *     falls back on it for the partial tiles at the edges.
+ */
+static void row_staged(cache_sim_t* sim, int i, int jj, int bw)
+{
+    int k;
+    for (k = 0; k < bw; k++)
+        if (jj + k < M)
+            LOAD_A(sim, i, jj + k);
+    for (k = 0; k < bw; k++)
+        if (jj + k < M)
+            STORE_B(sim, jj + k, i);
+}
+
+static void in_place_tile(cache_sim_t* sim, int ii, int jj, int w)
+{
+    int i, j;
+    if (ii + w > N || jj + w > M) {
+        for (i = ii; i < ii + w && i < N; i++)
+            row_staged(sim, i, jj, w);
+        return;
+    }
+    for (i = 0; i < w; i++) { /* copy row i of the A tile into row i of the B tile */
+        for (j = 0; j < w; j++)
+            LOAD_A(sim, ii + i, jj + j);
+        for (j = 0; j < w; j++)
+            STORE_B(sim, jj + i, ii + j);
+    }
+    for (i = 0; i < w; i++) { /* then swap across the tile's diagonal */
+        for (j = i + 1; j < w; j++) {
+            LOAD_B(sim, jj + i, ii + j);
+            LOAD_B(sim, jj + j, ii + i);
+            STORE_B(sim, jj + i, ii + j);
+            STORE_B(sim, jj + j, ii + i);
+        }
+    }
+}
+
+static void tile(cache_sim_t* sim, const tune_config_t* c, int ii, int jj)
+{
+    int i, j, d;
+
+    for (i = ii; i < ii + c->bh && i < N; i++) {
+        switch (c->kernel) {
+        case KERNEL_PLAIN:
+            for (j = jj; j < jj + c->bw && j < M; j++) {
+                LOAD_A(sim, i, j);
+                STORE_B(sim, j, i);
+            }
+            break;
+        case KERNEL_DEFER:
+            d = -1;
+            for (j = jj; j < jj + c->bw && j < M; j++) {
+                LOAD_A(sim, i, j);
+                if (i == j)
+                    d = i;
+                else
+                    STORE_B(sim, j, i);
+            }
+            if (d >= 0)
+                STORE_B(sim, d, d);
+            break;
+        case KERNEL_STAGED:
+            row_staged(sim, i, jj, c->bw);
+            break;
+        default:
+            in_place_tile(sim, ii, jj, c->bw);
+            return;
+        }
+    }
+}
+
+/*
+ * simulate - Fill in the hits and misses of one candidate
+ */
+static void simulate(tune_config_t* c, int s, int E, int b)
+{
+    cache_sim_t* sim = newCacheSim(s, E, b);
+    cache_stats_t stats;
+    int ii, jj;
+
+    /* The accesses runTraced makes around the call, as tracecall.c compiles */
+    cacheSimAccess(sim, 'S', TRACED_ADDR(markerStart), 1);
+    cacheSimAccess(sim, 'L', TRACED_ADDR(funcs) + tuned_index * sizeof(trans_func_t), 8);
+    cacheSimAccess(sim, 'L', TRACED_ADDR(N), 4);
+    cacheSimAccess(sim, 'L', TRACED_ADDR(M), 4);
+    if (c->cols_outer) {
+        for (jj = 0; jj < M; jj += c->bw)
+            for (ii = 0; ii < N; ii += c->bh)
+                tile(sim, c, ii, jj);
+    } else {
+        for (ii = 0; ii < N; ii += c->bh)
+            for (jj = 0; jj < M; jj += c->bw)
+                tile(sim, c, ii, jj);
+    }
+    cacheSimAccess(sim, 'S', TRACED_ADDR(markerEnd), 1);
+    stats = cacheSimStats(sim);
+    c->misses = stats.misses;
+    c->hits = stats.hits;
+    freeCacheSim(sim);
+}
+
+/* Fewest misses first, then fewest accesses, then the order they were tried in */
+static int better(const tune_config_t* x, const tune_config_t* y)
+{
+    if (x->misses != y->misses)
+        return x->misses < y->misses;
+    return x->misses + x->hits < y->misses + y->hits;
+}
+
+/*
+ * emit_staged_row - The C for one row-staged tile row, at the given indent
+ */
+static void emit_staged_row(FILE* fp, const char* indent, int bw)
+{
+    int k;
+    for (k = 0; k < bw; k++)
+        fprintf(fp, "%sif (jj + %d < M) t%d = A[i][jj + %d];\n", indent, k, k, k);
+    for (k = 0; k < bw; k++)
+        fprintf(fp, "%sif (jj + %d < M) B[jj + %d][i] = t%d;\n", indent, k, k, k);
+}
+
+/*
+ * emit - Write the chosen transpose and its registration function as C
+ */
+static int emit(const char* file, const tune_config_t* c, int s, int E, int b)
+{
+    const char* outer = c->cols_outer ? "jj" : "ii";
+    const char* inner = c->cols_outer ? "ii" : "jj";
+    int k;
+    FILE* fp = fopen(file, "w");
+
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+    fprintf(fp, "/*\n * %s - Generated by transtune -M %d -N %d -s %d -E %d -b %d; do not edit\n", file, M, N, s, E, b);
+    fprintf(fp, " *\n * %s kernel, %dx%d tiles, tile %s outer: %llu misses, %llu hits simulated.\n",
+            kernel_names[c->kernel], c->bh, c->bw, c->cols_outer ? "columns" : "rows", c->misses, c->hits);
+    fprintf(fp, " * It transposes any shape correctly, but is tuned for %d x %d.\n */\n", M, N);
+    fprintf(fp, "#include <stdio.h>\n#include \"cachelab.h\"\n\n");
+    fprintf(fp, "char transpose_tuned_desc[] = \"Tuned transpose (%s %dx%d tiles, %s outer)\";\n",
+            kernel_names[c->kernel], c->bh, c->bw, c->cols_outer ? "columns" : "rows");
+    fprintf(fp, "void transpose_tuned(int M, int N, int A[N][M], int B[M][N])\n{\n");
+    fprintf(fp, "    int ii, jj, i");
+    if (c->kernel != KERNEL_STAGED)
+        fprintf(fp, ", j");
+    if (c->kernel == KERNEL_DEFER)
+        fprintf(fp, ", d, t0 = 0");
+    if (c->kernel >= KERNEL_STAGED)
+        for (k = 0; k < c->bw; k++)
+            fprintf(fp, ", t%d = 0", k);
+    fprintf(fp, ";\n\n");
+    fprintf(fp, "    for (%s = 0; %s < %s; %s += %d) {\n", outer, outer, c->cols_outer ? "M" : "N", outer,
+            c->cols_outer ? c->bw : c->bh);
+    fprintf(fp, "        for (%s = 0; %s < %s; %s += %d) {\n", inner, inner, c->cols_outer ? "N" : "M", inner,
+            c->cols_outer ? c->bh : c->bw);
+
+    switch (c->kernel) {
+    case KERNEL_PLAIN:
+        fprintf(fp, "            for (i = ii; i < ii + %d && i < N; i++)\n", c->bh);
+        fprintf(fp, "                for (j = jj; j < jj + %d && j < M; j++)\n", c->bw);
+        fprintf(fp, "                    B[j][i] = A[i][j];\n");
+        break;
+    case KERNEL_DEFER:
+        fprintf(fp, "            for (i = ii; i < ii + %d && i < N; i++) {\n", c->bh);
+        fprintf(fp, "                d = -1;\n");
+        fprintf(fp, "                for (j = jj; j < jj + %d && j < M; j++) {\n", c->bw);
+        fprintf(fp, "                    if (i == j) {\n");
+        fprintf(fp, "                        t0 = A[i][j]; /* stored after the rest of the row */\n");
+        fprintf(fp, "                        d = i;\n");
+        fprintf(fp, "                    } else {\n");
+        fprintf(fp, "                        B[j][i] = A[i][j];\n");
+        fprintf(fp, "                    }\n");
+        fprintf(fp, "                }\n");
+        fprintf(fp, "                if (d >= 0)\n");
+        fprintf(fp, "                    B[d][d] = t0;\n");
+        fprintf(fp, "            }\n");
+        break;
+    case KERNEL_STAGED:
+        fprintf(fp, "            for (i = ii; i < ii + %d && i < N; i++) {\n", c->bh);
+        emit_staged_row(fp, "                ", c->bw);
+        fprintf(fp, "            }\n");
+        break;
+    default:
+        fprintf(fp, "            if (ii + %d > N || jj + %d > M) { /* a partial tile at the edge */\n", c->bw, c->bw);
+        fprintf(fp, "                for (i = ii; i < ii + %d && i < N; i++) {\n", c->bw);
+        emit_staged_row(fp, "                    ", c->bw);
+        fprintf(fp, "                }\n                continue;\n            }\n");
+        fprintf(fp, "            for (i = 0; i < %d; i++) { /* copy the A tile's rows into the B tile's */\n", c->bw);
+        for (k = 0; k < c->bw; k++)
+            fprintf(fp, "                t%d = A[ii + i][jj + %d];\n", k, k);
+        for (k = 0; k < c->bw; k++)
+            fprintf(fp, "                B[jj + i][ii + %d] = t%d;\n", k, k);
+        fprintf(fp, "            }\n");
+        fprintf(fp, "            for (i = 0; i < %d; i++) { /* then swap across the diagonal */\n", c->bw);
+        fprintf(fp, "                for (j = i + 1; j < %d; j++) {\n", c->bw);
+        fprintf(fp, "                    t0 = B[jj + i][ii + j];\n");
+        fprintf(fp, "                    B[jj + i][ii + j] = B[jj + j][ii + i];\n");
+        fprintf(fp, "                    B[jj + j][ii + i] = t0;\n");
+        fprintf(fp, "                }\n");
+        fprintf(fp, "            }\n");
+        break;
+    }
+    fprintf(fp, "        }\n    }\n}\n\n");
+    fprintf(fp, "/* Called by registerFunctions in trans.c when this file is linked in */\n");
+    fprintf(fp, "void registerTunedFunctions()\n{\n");
+    fprintf(fp, "    registerTransFunction(transpose_tuned, transpose_tuned_desc);\n}\n");
+    return fclose(fp) != 0;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -M <rows> -N <cols> [-s <s>] [-E <E>] [-b <b>] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <cols>   Number of columns of A, as for test-trans (max %d)\n", TRACE_MAXN);
+    printf("  -N <rows>   Number of rows of A (max %d)\n", TRACE_MAXN);
+    printf("  -s/-E/-b    Cache geometry to tune for (default 5, 1, 5 as in test-trans)\n");
+    printf("  -o <file>   Where to write the tuned transpose (default trans-tuned.c)\n");
+    printf("Example: %s -M 64 -N 64\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int s = 5, E = 1, b = 5;
+    char* file = "trans-tuned.c";
+    tune_config_t* configs;
+    int count = 0, kernel, order, bh, bw, i, j;
+    char c;
+
+    while ((c = getopt(argc, argv, "hM:N:s:E:b:o:")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'o':
+            file = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M < 1 || N < 1 || M > TRACE_MAXN || N > TRACE_MAXN || E < 1 || s < 0 || b < 2) {
+        printf("Error: Missing or invalid argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    /* The functions see A as N x M and B as M x N, both starting where traced's do */
+    a_base = TRACED_ADDR(A);
+    b_base = TRACED_ADDR(B);
+
+    /* The tuned function is registered after everything else in trans.c */
+    registerFunctions();
+    tuned_index = func_counter;
+
+    configs = malloc(NUM_KERNELS * 2 * MAX_TILE * MAX_TILE * sizeof(tune_config_t));
+    for (kernel = 0; kernel < NUM_KERNELS; kernel++) {
+        int most = kernel >= KERNEL_STAGED ? MAX_STAGED : MAX_TILE;
+        for (order = 0; order < 2; order++) {
+            for (bh = 1; bh <= most && bh <= N; bh++) {
+                for (bw = 1; bw <= most && bw <= M; bw++) {
+                    if (kernel == KERNEL_INPLACE && bh != bw)
+                        continue;
+                    configs[count].kernel = kernel;
+                    configs[count].cols_outer = order;
+                    configs[count].bh = bh;
+                    configs[count].bw = bw;
+                    simulate(&configs[count], s, E, b);
+                    count++;
+                }
+            }
+        }
+    }
+
+    /* Insertion sort keeps ties in the order they were tried */
+    for (i = 1; i < count; i++) {
+        tune_config_t x = configs[i];
+        for (j = i; j > 0 && better(&x, &configs[j - 1]); j--)
+            configs[j] = configs[j - 1];
+        configs[j] = x;
+    }
+
+    printf("Tried %d transposes of %d x %d for s=%d, E=%d, b=%d\n", count, M, N, s, E, b);
+    for (i = 0; i < count && i < SHOWN; i++)
+        printf("misses:%llu hits:%llu %s %dx%d tiles, %s outer\n", configs[i].misses, configs[i].hits,
+               kernel_names[configs[i].kernel], configs[i].bh, configs[i].bw,
+               configs[i].cols_outer ? "columns" : "rows");
+
+    if (emit(file, &configs[0], s, E, b) != 0) {
+        free(configs);
+        exit(1);
+    }
+    printf("Wrote the best one to %s\n", file);
+    free(configs);
+    return 0;
+}